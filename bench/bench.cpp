@@ -0,0 +1,435 @@
+#include "ClickHouseDB.h"
+#include "ClickHouseResult.h"
+
+#include <sapi/embed/php_embed.h>
+
+#include <chrono>
+#include <functional>
+
+// Benchmark of the conversion hot paths without a server: synthetic blocks are fetched and inserted through the same code as real results.
+// Build with "cmake --build <dir> --target bench" after the extension is built by phpize, run "bench [rows] [iterations]".
+
+static size_t cpp_allocations = 0;
+static size_t zend_allocations = 0;
+
+auto operator new(size_t size) -> void*
+{
+	cpp_allocations++;
+
+	void *ptr = malloc(size != 0 ? size : 1);
+	if (ptr == nullptr)
+		throw std::bad_alloc();
+
+	return ptr;
+}
+
+void operator delete(void *ptr) noexcept
+{
+	free(ptr);
+}
+
+void operator delete(void *ptr, size_t size) noexcept
+{
+	free(ptr);
+}
+
+#if ZEND_MM_CUSTOM && !ZEND_DEBUG
+// Zend heap stays the same, custom handlers only count calls and forward them to it
+static auto counting_malloc(size_t size) -> void*
+{
+	zend_allocations++;
+	return _zend_mm_alloc(zend_mm_get_heap(), size);
+}
+
+static void counting_free(void *ptr)
+{
+	_zend_mm_free(zend_mm_get_heap(), ptr);
+}
+
+static auto counting_realloc(void *ptr, size_t size) -> void*
+{
+	zend_allocations++;
+	return _zend_mm_realloc(zend_mm_get_heap(), ptr, size);
+}
+
+static void count_zend_allocations(bool enable)
+{
+	if (enable)
+		zend_mm_set_custom_handlers(zend_mm_get_heap(), counting_malloc, counting_free, counting_realloc);
+	else
+		zend_mm_set_custom_handlers(zend_mm_get_heap(), nullptr, nullptr, nullptr);
+}
+#else
+static void count_zend_allocations(bool enable)
+{}
+#endif
+
+struct ClickHouseBenchmark
+{
+	[[nodiscard]] static auto add_by_type(Block &block, zend_string *name, zend_ulong index, zval *z_value, const ColumnRef &description_column) -> bool
+	{
+		return ClickHouseDB::add_by_type(block, name, index, z_value, description_column);
+	}
+};
+
+struct Scenario
+{
+	const char *name;
+	Block block;
+	bool insertable;
+};
+
+static auto make_string(size_t row, size_t length) -> string
+{
+	string value(length, 'a');
+
+	for (size_t i = 0; i < length; i++)
+		value[i] = static_cast<char>('a' + (row * 31 + i * 7) % 26);
+
+	return value;
+}
+
+static auto make_numeric(size_t rows) -> Block
+{
+	Block block;
+
+	for (size_t i = 0; i < 4; i++)
+	{
+		auto unsigned_column = make_shared<ColumnUInt64>();
+		auto signed_column = make_shared<ColumnInt32>();
+		auto small_column = make_shared<ColumnUInt8>();
+		auto float_column = make_shared<ColumnFloat64>();
+
+		for (size_t row = 0; row < rows; row++)
+		{
+			unsigned_column->Append(row * 1000003);
+			signed_column->Append(static_cast<int32_t>(row) - 1000);
+			small_column->Append(static_cast<uint8_t>(row));
+			float_column->Append(static_cast<double>(row) / 3);
+		}
+
+		block.AppendColumn("uint64_" + std::to_string(i), unsigned_column);
+		block.AppendColumn("int32_" + std::to_string(i), signed_column);
+		block.AppendColumn("uint8_" + std::to_string(i), small_column);
+		block.AppendColumn("float64_" + std::to_string(i), float_column);
+	}
+
+	return block;
+}
+
+static auto make_strings(size_t rows) -> Block
+{
+	Block block;
+
+	auto id = make_shared<ColumnUInt64>();
+	auto url = make_shared<ColumnString>();
+	auto user_agent = make_shared<ColumnString>();
+	auto referer = make_shared<ColumnString>();
+	auto code = make_shared<ColumnFixedString>(8);
+
+	for (size_t row = 0; row < rows; row++)
+	{
+		id->Append(row);
+		url->Append(make_string(row, 40 + row % 60));
+		user_agent->Append(make_string(row, 120));
+		referer->Append(make_string(row, row % 80));
+		code->Append(make_string(row, 8));
+	}
+
+	block.AppendColumn("id", id);
+	block.AppendColumn("url", url);
+	block.AppendColumn("user_agent", user_agent);
+	block.AppendColumn("referer", referer);
+	block.AppendColumn("code", code);
+
+	return block;
+}
+
+static auto make_nullable(size_t rows) -> Block
+{
+	Block block;
+
+	auto long_values = make_shared<ColumnInt64>();
+	auto long_nulls = make_shared<ColumnUInt8>();
+	auto string_values = make_shared<ColumnString>();
+	auto string_nulls = make_shared<ColumnUInt8>();
+
+	for (size_t row = 0; row < rows; row++)
+	{
+		long_values->Append(static_cast<int64_t>(row));
+		long_nulls->Append(row % 3 == 0 ? 1 : 0);
+
+		string_values->Append(make_string(row, 24));
+		string_nulls->Append(row % 4 == 0 ? 1 : 0);
+	}
+
+	block.AppendColumn("nullable_long", make_shared<ColumnNullable>(long_values, long_nulls));
+	block.AppendColumn("nullable_string", make_shared<ColumnNullable>(string_values, string_nulls));
+
+	return block;
+}
+
+static auto make_low_cardinality(size_t rows) -> Block
+{
+	Block block;
+
+	auto country = make_shared<ColumnLowCardinalityT<ColumnString>>();
+	auto browser = make_shared<ColumnLowCardinalityT<ColumnString>>();
+
+	for (size_t row = 0; row < rows; row++)
+	{
+		country->Append(make_string(row % 200, 2));
+		browser->Append(make_string(row % 20, 12));
+	}
+
+	block.AppendColumn("country", country);
+	block.AppendColumn("browser", browser);
+
+	return block;
+}
+
+static auto make_dates(size_t rows) -> Block
+{
+	Block block;
+
+	auto date = make_shared<ColumnDate>();
+	auto date_time = make_shared<ColumnDateTime>();
+
+	for (size_t row = 0; row < rows; row++)
+	{
+		date->Append(static_cast<time_t>(1609459200 + (row % 1000) * 86400));
+		date_time->Append(static_cast<time_t>(1609459200 + row * 17));
+	}
+
+	block.AppendColumn("date", date);
+	block.AppendColumn("date_time", date_time);
+
+	return block;
+}
+
+static auto make_decimals(size_t rows) -> Block
+{
+	Block block;
+
+	auto amount = make_shared<ColumnDecimal>(38, 4);
+	auto price = make_shared<ColumnDecimal>(38, 2);
+
+	for (size_t row = 0; row < rows; row++)
+	{
+		amount->Append(Int128(static_cast<int64_t>(row * 12345)));
+		price->Append(Int128(static_cast<int64_t>(row % 100000)) * 1000000000000LL);
+	}
+
+	block.AppendColumn("amount", amount);
+	block.AppendColumn("price", price);
+
+	return block;
+}
+
+static void report(const char *scenario, const char *path, size_t rows, std::chrono::steady_clock::duration elapsed)
+{
+	double seconds = std::chrono::duration<double>(elapsed).count();
+
+	php_printf("%-16s %-12s %12.0f rows/s %10.2f zend allocs/row %10.2f c++ allocs/row\n", scenario, path, static_cast<double>(rows) / seconds, static_cast<double>(zend_allocations) / static_cast<double>(rows), static_cast<double>(cpp_allocations) / static_cast<double>(rows));
+}
+
+static void measure(const char *scenario, const char *path, size_t rows, const std::function<void()> &run)
+{
+	cpp_allocations = 0;
+	zend_allocations = 0;
+
+	count_zend_allocations(true);
+
+	auto start = std::chrono::steady_clock::now();
+	run();
+	auto elapsed = std::chrono::steady_clock::now() - start;
+
+	count_zend_allocations(false);
+
+	report(scenario, path, rows, elapsed);
+}
+
+static auto make_result(const Block &block, size_t iterations) -> zend_object*
+{
+	// Blocks share columns, copies are cheap and fetching doesn't modify them
+	deque<Block> blocks(iterations, block);
+
+	return clickhouse_result_new(std::move(blocks), {}, block.GetRowCount() * iterations, 0, ClickHouseResult::STORE_RESULT, make_shared<ClickHouseStats>());
+}
+
+static auto clone_block(const Block &block) -> Block
+{
+	Block result;
+
+	for (size_t i = 0; i < block.GetColumnCount(); i++)
+		result.AppendColumn(block.GetColumnName(i), block[i]->Slice(0, block.GetRowCount()));
+
+	return result;
+}
+
+static auto get_result(zend_object *obj) -> ClickHouseResult*
+{
+	return reinterpret_cast<ClickHouseResultObject*>(reinterpret_cast<char*>(obj) - XtOffsetOf(ClickHouseResultObject, std))->impl;
+}
+
+static void run_scenario(const Scenario &scenario, size_t iterations)
+{
+	size_t rows = scenario.block.GetRowCount() * iterations;
+
+	zend_object *result = make_result(scenario.block, iterations);
+	measure(scenario.name, "fetch_assoc", rows, [result]
+	{
+		zval row;
+		while (get_result(result)->fetch_assoc(&row))
+			zval_ptr_dtor(&row);
+	});
+	OBJ_RELEASE(result);
+
+	result = make_result(scenario.block, iterations);
+	measure(scenario.name, "fetch_all", rows, [result]
+	{
+		zval rows_array;
+		if (get_result(result)->fetch_all(&rows_array, ClickHouseResult::FetchType::ASSOC))
+			zval_ptr_dtor(&rows_array);
+	});
+	OBJ_RELEASE(result);
+
+	result = make_result(scenario.block, iterations);
+	measure(scenario.name, "fetch_block", rows, [result]
+	{
+		zval rows_array;
+		while (get_result(result)->fetch_block(&rows_array, ClickHouseResult::FetchType::ASSOC))
+			zval_ptr_dtor(&rows_array);
+	});
+	OBJ_RELEASE(result);
+
+	// All mapping flags: dates as timestamps, decimals and big integers as floats, no formatting
+	result = make_result(scenario.block, iterations);
+	(void)get_result(result)->set_type_mapping(ClickHouseResult::MAPPING_MASK);
+	measure(scenario.name, "fetch_mapped", rows, [result]
+	{
+		zval rows_array;
+		if (get_result(result)->fetch_all(&rows_array, ClickHouseResult::FetchType::ASSOC))
+			zval_ptr_dtor(&rows_array);
+	});
+	OBJ_RELEASE(result);
+
+	// String columns are decoded the same way as on block arrival, blocks are cloned because decoding clears them
+	deque<Block> direct_blocks;
+	for (size_t i = 0; i < iterations; i++)
+		direct_blocks.push_back(clone_block(scenario.block));
+
+	measure(scenario.name, "direct_str", rows, [&scenario, &direct_blocks, iterations]
+	{
+		deque<Block> blocks = std::move(direct_blocks);
+		deque<ClickHouseResult::BlockStrings> strings;
+
+		for (const Block &block : blocks)
+			strings.push_back(ClickHouseResult::decode_strings(block));
+
+		zend_object *direct_result = clickhouse_result_new(std::move(blocks), std::move(strings), scenario.block.GetRowCount() * iterations, 0, ClickHouseResult::STORE_RESULT, make_shared<ClickHouseStats>());
+
+		zval rows_array;
+		if (get_result(direct_result)->fetch_all(&rows_array, ClickHouseResult::FetchType::ASSOC))
+			zval_ptr_dtor(&rows_array);
+
+		OBJ_RELEASE(direct_result);
+	});
+
+	if (!scenario.insertable)
+		return;
+
+	// Rows fetched as PHP values are used as the insert data, so they always match the column types
+	zval values;
+
+	result = make_result(scenario.block, 1);
+	if (!get_result(result)->fetch_all(&values, ClickHouseResult::FetchType::NUM))
+	{
+		OBJ_RELEASE(result);
+		return;
+	}
+	OBJ_RELEASE(result);
+
+	size_t columns = scenario.block.GetColumnCount();
+
+	vector<zend_string*> names;
+	for (size_t i = 0; i < columns; i++)
+		names.push_back(zend_string_init(scenario.block.GetColumnName(i).data(), scenario.block.GetColumnName(i).length(), 0));
+
+	measure(scenario.name, "add_by_type", rows, [&scenario, &names, &values, iterations]
+	{
+		for (size_t i = 0; i < iterations; i++)
+		{
+			Block block;
+
+			zval *row;
+			ZEND_HASH_FOREACH_VAL(Z_ARR(values), row)
+			{
+				zend_ulong index;
+				zval *value;
+
+				ZEND_HASH_FOREACH_NUM_KEY_VAL(Z_ARR_P(row), index, value)
+				{
+					if (!ClickHouseBenchmark::add_by_type(block, names[index], index, value, scenario.block[index]))
+						return;
+				}
+				ZEND_HASH_FOREACH_END();
+			}
+			ZEND_HASH_FOREACH_END();
+
+			block.RefreshRowCount();
+		}
+	});
+
+	for (zend_string *name : names)
+		zend_string_release(name);
+
+	zval_ptr_dtor(&values);
+}
+
+static auto benchmark_startup(sapi_module_struct *sapi_module) -> decltype(php_embed_module.startup(sapi_module))
+{
+#if PHP_VERSION_ID >= 80200
+	return php_module_startup(sapi_module, &clickhouse_module_entry);
+#else
+	return php_module_startup(sapi_module, &clickhouse_module_entry, 1);
+#endif
+}
+
+auto main(int argc, char **argv) -> int
+{
+	size_t rows = argc > 1 ? strtoul(argv[1], nullptr, 10) : 65536;
+	size_t iterations = argc > 2 ? strtoul(argv[2], nullptr, 10) : 16;
+
+	if (rows == 0 || iterations == 0)
+	{
+		fprintf(stderr, "Usage: %s [rows per block] [iterations]\n", argv[0]);
+		return 1;
+	}
+
+	php_embed_module.startup = benchmark_startup;
+
+	if (php_embed_init(argc, argv) == FAILURE)
+	{
+		fprintf(stderr, "Failed to start PHP\n");
+		return 1;
+	}
+
+	vector<Scenario> scenarios;
+	scenarios.push_back({"numeric", make_numeric(rows), true});
+	scenarios.push_back({"strings", make_strings(rows), true});
+	scenarios.push_back({"nullable", make_nullable(rows), true});
+	scenarios.push_back({"low_cardinality", make_low_cardinality(rows), false});
+	scenarios.push_back({"dates", make_dates(rows), true});
+	scenarios.push_back({"decimal128", make_decimals(rows), false});
+
+	php_printf("%lu rows per block, %lu blocks\n", rows, iterations);
+
+	for (const Scenario &scenario : scenarios)
+		run_scenario(scenario, iterations);
+
+	scenarios.clear();
+
+	php_embed_shutdown();
+	return 0;
+}
\ No newline at end of file
@@ -0,0 +1,101 @@
+<?php
+
+	// End-to-end checks and load benchmark against bench/fake_server, no real ClickHouse needed
+	// Usage: php -d extension=modules/clickhouse.so [-d clickhouse.cache_size=256M] bench/e2e.php [port] [connections] [queries per connection]
+
+	$port = (int)($argv[1] ?? 9001);
+	$connections = (int)($argv[2] ?? 4);
+	$queries = (int)($argv[3] ?? 10);
+
+	function check($condition, $message)
+	{
+		if ($condition)
+			return;
+
+		fwrite(STDERR, "FAILED: ".$message."\n");
+		exit(1);
+	}
+
+	$ch = new ClickHouse("127.0.0.1", "default", "", "default", $port);
+
+	$result = $ch->query("SELECT * FROM test") or check(false, "Query failed: ".$ch->error." (".$ch->errno.")");
+
+	$rows = 0;
+	while ($row = $result->fetch_assoc())
+	{
+		check(isset($row['id']), "Column id is missing");
+		$rows++;
+	}
+	check($rows > 0, "No rows received");
+
+	echo "Select: ".$rows." rows\n";
+
+	$result = $ch->query("SELECT fake_exception");
+	check($result === false && $ch->errno == 1000, "Server exception is not reported");
+
+	$result = $ch->query("SELECT 1") or check(false, "Connection is not usable after exception: ".$ch->error);
+
+	$ch->insert("test",
+		array(
+			array(1, "a"),
+			array(2, "b")
+		),
+		array("id", "name")
+	) or check(false, "Insert failed: ".$ch->error." (".$ch->errno.")");
+
+	echo "Insert: ok\n";
+
+	// Cached result with direct strings must be the same as the one from the server, String columns are cleared by decoding
+	if ((int)ini_get("clickhouse.cache_size") > 0)
+	{
+		$hits = $ch->get_stats()['cache_hits'];
+
+		$received = $ch->query("SELECT * FROM test", CLICKHOUSE_DIRECT_STRINGS, null, 60) or check(false, "Cached query failed: ".$ch->error." (".$ch->errno.")");
+		$cached = $ch->query("SELECT * FROM test", CLICKHOUSE_DIRECT_STRINGS, null, 60) or check(false, "Cached query failed: ".$ch->error." (".$ch->errno.")");
+
+		check($ch->get_stats()['cache_hits'] == $hits + 1, "Cached result with direct strings is not hit");
+		check($cached->num_rows == $received->num_rows, "Cached result has ".$cached->num_rows." rows instead of ".$received->num_rows);
+
+		while ($row = $received->fetch_assoc())
+			check($cached->fetch_assoc() === $row, "Cached rows differ from received ones");
+
+		echo "Cache: ok\n";
+	}
+	else
+		echo "Cache: skipped, clickhouse.cache_size is not set\n";
+
+	// Load: each forked process keeps one connection and runs queries one by one
+	$time = microtime(true);
+
+	$children = array();
+	for ($i = 0; $i < $connections; $i++)
+	{
+		$pid = pcntl_fork();
+		if ($pid == 0)
+		{
+			$ch = new ClickHouse("127.0.0.1", "default", "", "default", $port);
+
+			for ($j = 0; $j < $queries; $j++)
+			{
+				$result = $ch->query("SELECT * FROM test");
+				if ($result === false)
+					continue;
+
+				$data = $result->fetch_all(CLICKHOUSE_ASSOC);
+				unset($data);
+			}
+
+			exit(0);
+		}
+
+		$children[] = $pid;
+	}
+
+	foreach ($children as $pid)
+		pcntl_waitpid($pid, $status);
+
+	$elapsed = microtime(true) - $time;
+
+	printf("Load: %d connections, %d queries, %.3f s, %.1f queries/s, %.0f rows/s\n", $connections, $connections * $queries, $elapsed, $connections * $queries / $elapsed, $connections * $queries * $rows / $elapsed);
+
+?>
\ No newline at end of file
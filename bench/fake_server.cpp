@@ -0,0 +1,888 @@
+#include "clickhouse/base/wire_format.h"
+#include "clickhouse/base/compressed.h"
+#include "clickhouse/base/input.h"
+#include "clickhouse/base/output.h"
+#include "clickhouse/columns/factory.h"
+
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+#include <poll.h>
+#include <csignal>
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+// Stand-in for ClickHouse server speaking the native TCP protocol over loopback, for end-to-end tests and load benchmarks without a cluster.
+// Every SELECT returns generated rows of the configured schema, INSERT accepts any rows for the columns of the schema.
+// Queries containing "fake_settings" return received settings, queries containing "fake_exception" fail.
+
+namespace
+{
+
+namespace ClientCodes
+{
+	constexpr uint64_t Hello = 0;
+	constexpr uint64_t Query = 1;
+	constexpr uint64_t Data = 2;
+	constexpr uint64_t Cancel = 3;
+	constexpr uint64_t Ping = 4;
+}
+
+namespace ServerCodes
+{
+	constexpr uint64_t Hello = 0;
+	constexpr uint64_t Data = 1;
+	constexpr uint64_t Exception = 2;
+	constexpr uint64_t Progress = 3;
+	constexpr uint64_t Pong = 4;
+	constexpr uint64_t EndOfStream = 5;
+	constexpr uint64_t ProfileInfo = 6;
+}
+
+// Settings are sent as strings starting from this revision, older revisions are not needed for clickhouse-cpp
+constexpr uint64_t REVISION = 54429;
+
+constexpr uint64_t REVISION_WITH_TEMPORARY_TABLES = 50264;
+constexpr uint64_t REVISION_WITH_TOTAL_ROWS_IN_PROGRESS = 51554;
+constexpr uint64_t REVISION_WITH_BLOCK_INFO = 51903;
+constexpr uint64_t REVISION_WITH_CLIENT_INFO = 54032;
+constexpr uint64_t REVISION_WITH_SERVER_TIMEZONE = 54058;
+constexpr uint64_t REVISION_WITH_QUOTA_KEY_IN_CLIENT_INFO = 54060;
+constexpr uint64_t REVISION_WITH_SERVER_DISPLAY_NAME = 54372;
+constexpr uint64_t REVISION_WITH_VERSION_PATCH = 54401;
+constexpr uint64_t REVISION_WITH_CLIENT_WRITE_INFO = 54420;
+
+constexpr uint8_t INTERFACE_TCP = 1;
+
+struct Options
+{
+	uint16_t port = 9001;
+
+	string schema = "id UInt64, name String, value Float64, created DateTime, day Date, flag Nullable(UInt8)";
+	size_t rows = 100000;
+	size_t block_rows = 65536;
+
+	unsigned latency_ms = 0;
+	unsigned block_latency_ms = 0;
+
+	size_t error_every = 0;
+	size_t drop_every = 0;
+
+	bool verbose = false;
+};
+
+Options options;
+vector<pair<string, string>> schema;
+
+std::atomic<size_t> queries_count = 0;
+
+class SocketInput : public ZeroCopyInput
+{
+private:
+	int fd;
+
+	vector<uint8_t> buffer;
+	size_t begin;
+	size_t end;
+
+protected:
+	auto DoNext(const void **ptr, size_t len) -> size_t override
+	{
+		if (this->begin == this->end)
+		{
+			ssize_t received = recv(this->fd, this->buffer.data(), this->buffer.size(), 0);
+			if (received <= 0)
+				return 0;
+
+			this->begin = 0;
+			this->end = static_cast<size_t>(received);
+		}
+
+		len = std::min(len, this->end - this->begin);
+
+		*ptr = this->buffer.data() + this->begin;
+		this->begin += len;
+
+		return len;
+	}
+
+public:
+	explicit SocketInput(int fd):
+		fd(fd), buffer(64 * 1024), begin(0), end(0)
+	{}
+
+	[[nodiscard]] auto has_data() const -> bool
+	{
+		if (this->begin != this->end)
+			return true;
+
+		pollfd descriptor{this->fd, POLLIN, 0};
+		return poll(&descriptor, 1, 0) > 0;
+	}
+};
+
+auto split_columns(const string &text) -> vector<string>
+{
+	vector<string> result;
+
+	int depth = 0;
+	string current;
+
+	for (char c : text)
+	{
+		if (c == '(')
+			depth++;
+		else if (c == ')')
+			depth--;
+
+		if (c == ',' && depth == 0)
+		{
+			result.push_back(current);
+			current.clear();
+			continue;
+		}
+
+		current.push_back(c);
+	}
+
+	if (!current.empty())
+		result.push_back(current);
+
+	for (string &item : result)
+	{
+		item.erase(0, item.find_first_not_of(" \t\r\n`"));
+		item.erase(item.find_last_not_of(" \t\r\n`") + 1);
+	}
+
+	return result;
+}
+
+auto parse_schema(const string &text) -> bool
+{
+	for (const string &column : split_columns(text))
+	{
+		size_t space = column.find(' ');
+		if (space == string::npos)
+		{
+			fprintf(stderr, "Column '%s' has no type\n", column.c_str());
+			return false;
+		}
+
+		schema.emplace_back(column.substr(0, space), column.substr(column.find_first_not_of(' ', space)));
+	}
+
+	return !schema.empty();
+}
+
+template<class T>
+void fill_numeric(const ColumnRef &column, size_t rows, size_t offset)
+{
+	auto typed = column->As<T>();
+
+	for (size_t row = 0; row < rows; row++)
+		typed->Append(static_cast<typename T::ValueType>((offset + row) % 100000));
+}
+
+void fill_column(const ColumnRef &column, size_t rows, size_t offset)
+{
+	// ReSharper disable once CppTooWideScope
+	Type::Code type_code = column->Type()->GetCode();
+
+	switch (type_code)
+	{
+		case Type::Code::Int8:
+			fill_numeric<ColumnInt8>(column, rows, offset);
+			break;
+		case Type::Code::Int16:
+			fill_numeric<ColumnInt16>(column, rows, offset);
+			break;
+		case Type::Code::Int32:
+			fill_numeric<ColumnInt32>(column, rows, offset);
+			break;
+		case Type::Code::Int64:
+			fill_numeric<ColumnInt64>(column, rows, offset);
+			break;
+		case Type::Code::UInt8:
+			fill_numeric<ColumnUInt8>(column, rows, offset);
+			break;
+		case Type::Code::UInt16:
+			fill_numeric<ColumnUInt16>(column, rows, offset);
+			break;
+		case Type::Code::UInt32:
+			fill_numeric<ColumnUInt32>(column, rows, offset);
+			break;
+		case Type::Code::UInt64:
+			fill_numeric<ColumnUInt64>(column, rows, offset);
+			break;
+		case Type::Code::Float32:
+			fill_numeric<ColumnFloat32>(column, rows, offset);
+			break;
+		case Type::Code::Float64:
+			fill_numeric<ColumnFloat64>(column, rows, offset);
+			break;
+		case Type::Code::String:
+			for (size_t row = 0; row < rows; row++)
+				column->As<ColumnString>()->Append("value_" + std::to_string(offset + row));
+			break;
+		case Type::Code::FixedString:
+		{
+			auto typed = column->As<ColumnFixedString>();
+
+			for (size_t row = 0; row < rows; row++)
+				typed->Append(string(typed->FixedSize(), static_cast<char>('a' + (offset + row) % 26)));
+			break;
+		}
+		case Type::Code::DateTime:
+			for (size_t row = 0; row < rows; row++)
+				column->As<ColumnDateTime>()->Append(static_cast<time_t>(1600000000 + offset + row));
+			break;
+		case Type::Code::Date:
+			for (size_t row = 0; row < rows; row++)
+				column->As<ColumnDate>()->Append(static_cast<time_t>((18000 + (offset + row) % 1000) * 86400));
+			break;
+		case Type::Code::Nullable:
+		{
+			auto nullable = column->As<ColumnNullable>();
+
+			fill_column(nullable->Nested(), rows, offset);
+
+			for (size_t row = 0; row < rows; row++)
+				nullable->Nulls()->As<ColumnUInt8>()->Append((offset + row) % 5 == 0 ? 1 : 0);
+			break;
+		}
+		case Type::Code::UUID:
+			for (size_t row = 0; row < rows; row++)
+				column->As<ColumnUUID>()->Append(UUID(offset + row, ~(offset + row)));
+			break;
+		case Type::Code::Decimal:
+		case Type::Code::Decimal32:
+		case Type::Code::Decimal64:
+		case Type::Code::Decimal128:
+			for (size_t row = 0; row < rows; row++)
+				column->As<ColumnDecimal>()->Append(Int128(static_cast<int64_t>(offset + row)));
+			break;
+		case Type::Code::LowCardinality:
+			for (size_t row = 0; row < rows; row++)
+				column->As<ColumnLowCardinalityT<ColumnString>>()->Append("value_" + std::to_string((offset + row) % 100));
+			break;
+		default:
+			throw std::runtime_error("Type " + column->Type()->GetName() + " is not supported by fake server");
+	}
+}
+
+auto make_block(const vector<pair<string, string>> &columns, size_t rows, size_t offset) -> Block
+{
+	Block block;
+
+	for (const auto &[name, type] : columns)
+	{
+		ColumnRef column = CreateColumnByType(type);
+		if (column == nullptr)
+			throw std::runtime_error("Unknown type " + type);
+
+		fill_column(column, rows, offset);
+		block.AppendColumn(name, column);
+	}
+
+	return block;
+}
+
+auto contains(const string &text, const char *pattern) -> bool
+{
+	return text.find(pattern) != string::npos;
+}
+
+class Connection
+{
+private:
+	int fd;
+	SocketInput input;
+
+	uint64_t revision;
+	bool compression;
+
+	vector<pair<string, string>> settings;
+
+	void send(const Buffer &buffer) const
+	{
+		size_t sent = 0;
+
+		while (sent < buffer.size())
+		{
+			ssize_t result = ::send(this->fd, buffer.data() + sent, buffer.size() - sent, MSG_NOSIGNAL);
+			if (result <= 0)
+				throw std::runtime_error("Failed to send data to client");
+
+			sent += static_cast<size_t>(result);
+		}
+	}
+
+	void write_block(OutputStream &output, const Block &block) const
+	{
+		if (this->revision >= REVISION_WITH_BLOCK_INFO)
+		{
+			WireFormat::WriteUInt64(output, 1);
+			WireFormat::WriteFixed<uint8_t>(output, 0);
+			WireFormat::WriteUInt64(output, 2);
+			WireFormat::WriteFixed<int32_t>(output, -1);
+			WireFormat::WriteUInt64(output, 0);
+		}
+
+		WireFormat::WriteUInt64(output, block.GetColumnCount());
+		WireFormat::WriteUInt64(output, block.GetRowCount());
+
+		for (size_t i = 0; i < block.GetColumnCount(); i++)
+		{
+			WireFormat::WriteString(output, block.GetColumnName(i));
+			WireFormat::WriteString(output, block[i]->Type()->GetName());
+
+			if (block.GetRowCount() != 0)
+				block[i]->Save(&output);
+		}
+	}
+
+	[[nodiscard]] auto read_block(InputStream &input, Block &block) const -> bool
+	{
+		uint64_t columns;
+		uint64_t rows;
+
+		if (this->revision >= REVISION_WITH_BLOCK_INFO)
+		{
+			uint64_t field;
+			uint8_t is_overflows;
+			int32_t bucket_num;
+
+			if (!WireFormat::ReadUInt64(input, &field) || !WireFormat::ReadFixed(input, &is_overflows))
+				return false;
+			if (!WireFormat::ReadUInt64(input, &field) || !WireFormat::ReadFixed(input, &bucket_num))
+				return false;
+			if (!WireFormat::ReadUInt64(input, &field))
+				return false;
+		}
+
+		if (!WireFormat::ReadUInt64(input, &columns) || !WireFormat::ReadUInt64(input, &rows))
+			return false;
+
+		for (uint64_t i = 0; i < columns; i++)
+		{
+			string name;
+			string type;
+
+			if (!WireFormat::ReadString(input, &name) || !WireFormat::ReadString(input, &type))
+				return false;
+
+			ColumnRef column = CreateColumnByType(type);
+			if (column == nullptr || (rows != 0 && !column->Load(&input, rows)))
+				return false;
+
+			block.AppendColumn(name, column);
+		}
+
+		return true;
+	}
+
+	[[nodiscard]] auto receive_data(Block &block) -> bool
+	{
+		uint64_t packet;
+		if (!WireFormat::ReadUInt64(this->input, &packet) || packet != ClientCodes::Data)
+			return false;
+
+		string table_name;
+		if (this->revision >= REVISION_WITH_TEMPORARY_TABLES && !WireFormat::ReadString(this->input, &table_name))
+			return false;
+
+		if (!this->compression)
+			return this->read_block(this->input, block);
+
+		CompressedInput compressed(&this->input);
+		return this->read_block(compressed, block);
+	}
+
+	void send_hello() const
+	{
+		Buffer buffer;
+		BufferOutput output(&buffer);
+
+		WireFormat::WriteUInt64(output, ServerCodes::Hello);
+		WireFormat::WriteString(output, "ClickHouse");
+		WireFormat::WriteUInt64(output, 23);
+		WireFormat::WriteUInt64(output, 8);
+		WireFormat::WriteUInt64(output, this->revision);
+
+		if (this->revision >= REVISION_WITH_SERVER_TIMEZONE)
+			WireFormat::WriteString(output, "UTC");
+		if (this->revision >= REVISION_WITH_SERVER_DISPLAY_NAME)
+			WireFormat::WriteString(output, "fake-server");
+		if (this->revision >= REVISION_WITH_VERSION_PATCH)
+			WireFormat::WriteUInt64(output, 1);
+
+		output.Flush();
+		this->send(buffer);
+	}
+
+	void send_data(const Block &block) const
+	{
+		Buffer buffer;
+		BufferOutput output(&buffer);
+
+		WireFormat::WriteUInt64(output, ServerCodes::Data);
+		if (this->revision >= REVISION_WITH_TEMPORARY_TABLES)
+			WireFormat::WriteString(output, "");
+
+		if (this->compression)
+		{
+			CompressedOutput compressed(&output);
+			this->write_block(compressed, block);
+			compressed.Flush();
+		}
+		else
+			this->write_block(output, block);
+
+		output.Flush();
+		this->send(buffer);
+	}
+
+	void send_exception(int32_t code, const string &message) const
+	{
+		Buffer buffer;
+		BufferOutput output(&buffer);
+
+		WireFormat::WriteUInt64(output, ServerCodes::Exception);
+		WireFormat::WriteFixed<int32_t>(output, code);
+		WireFormat::WriteString(output, "DB::Exception");
+		WireFormat::WriteString(output, message);
+		WireFormat::WriteString(output, "");
+		WireFormat::WriteFixed<uint8_t>(output, 0);
+
+		output.Flush();
+		this->send(buffer);
+	}
+
+	void send_end_of_query(uint64_t rows, uint64_t blocks, uint64_t bytes) const
+	{
+		Buffer buffer;
+		BufferOutput output(&buffer);
+
+		WireFormat::WriteUInt64(output, ServerCodes::Progress);
+		WireFormat::WriteUInt64(output, rows);
+		WireFormat::WriteUInt64(output, bytes);
+		if (this->revision >= REVISION_WITH_TOTAL_ROWS_IN_PROGRESS)
+			WireFormat::WriteUInt64(output, rows);
+		if (this->revision >= REVISION_WITH_CLIENT_WRITE_INFO)
+		{
+			WireFormat::WriteUInt64(output, 0);
+			WireFormat::WriteUInt64(output, 0);
+		}
+
+		WireFormat::WriteUInt64(output, ServerCodes::ProfileInfo);
+		WireFormat::WriteUInt64(output, rows);
+		WireFormat::WriteUInt64(output, blocks);
+		WireFormat::WriteUInt64(output, bytes);
+		WireFormat::WriteFixed<uint8_t>(output, 0);
+		WireFormat::WriteUInt64(output, 0);
+		WireFormat::WriteFixed<uint8_t>(output, 0);
+
+		WireFormat::WriteUInt64(output, ServerCodes::EndOfStream);
+
+		output.Flush();
+		this->send(buffer);
+	}
+
+	void send_pong() const
+	{
+		Buffer buffer;
+		BufferOutput output(&buffer);
+
+		WireFormat::WriteUInt64(output, ServerCodes::Pong);
+
+		output.Flush();
+		this->send(buffer);
+	}
+
+	[[nodiscard]] auto receive_hello() -> bool
+	{
+		uint64_t packet;
+		if (!WireFormat::ReadUInt64(this->input, &packet) || packet != ClientCodes::Hello)
+			return false;
+
+		string client_name;
+		uint64_t major;
+		uint64_t minor;
+		uint64_t client_revision;
+		string database;
+		string user;
+		string password;
+
+		if (!WireFormat::ReadString(this->input, &client_name) || !WireFormat::ReadUInt64(this->input, &major) || !WireFormat::ReadUInt64(this->input, &minor) || !WireFormat::ReadUInt64(this->input, &client_revision))
+			return false;
+		if (!WireFormat::ReadString(this->input, &database) || !WireFormat::ReadString(this->input, &user) || !WireFormat::ReadString(this->input, &password))
+			return false;
+
+		this->revision = std::min(client_revision, REVISION);
+
+		if (options.verbose)
+			fprintf(stderr, "Hello from %s %lu.%lu revision %lu, user '%s', database '%s'\n", client_name.c_str(), major, minor, client_revision, user.c_str(), database.c_str());
+
+		return true;
+	}
+
+	[[nodiscard]] auto receive_query(string &query) -> bool
+	{
+		string query_id;
+		if (!WireFormat::ReadString(this->input, &query_id))
+			return false;
+
+		if (this->revision >= REVISION_WITH_CLIENT_INFO)
+		{
+			uint8_t query_kind;
+			if (!WireFormat::ReadFixed(this->input, &query_kind))
+				return false;
+
+			if (query_kind != 0)
+			{
+				string initial_user;
+				string initial_query_id;
+				string initial_address;
+				uint8_t interface;
+
+				if (!WireFormat::ReadString(this->input, &initial_user) || !WireFormat::ReadString(this->input, &initial_query_id) || !WireFormat::ReadString(this->input, &initial_address))
+					return false;
+				if (!WireFormat::ReadFixed(this->input, &interface))
+					return false;
+
+				if (interface == INTERFACE_TCP)
+				{
+					string os_user;
+					string hostname;
+					string client_name;
+					uint64_t version;
+
+					if (!WireFormat::ReadString(this->input, &os_user) || !WireFormat::ReadString(this->input, &hostname) || !WireFormat::ReadString(this->input, &client_name))
+						return false;
+					for (int i = 0; i < 3; i++)
+					{
+						if (!WireFormat::ReadUInt64(this->input, &version))
+							return false;
+					}
+				}
+
+				string quota_key;
+				if (this->revision >= REVISION_WITH_QUOTA_KEY_IN_CLIENT_INFO && !WireFormat::ReadString(this->input, &quota_key))
+					return false;
+
+				uint64_t version_patch;
+				if (interface == INTERFACE_TCP && this->revision >= REVISION_WITH_VERSION_PATCH && !WireFormat::ReadUInt64(this->input, &version_patch))
+					return false;
+			}
+		}
+
+		this->settings.clear();
+
+		while (true)
+		{
+			string name;
+			uint64_t flags;
+			string value;
+
+			if (!WireFormat::ReadString(this->input, &name))
+				return false;
+
+			if (name.empty())
+				break;
+
+			if (!WireFormat::ReadUInt64(this->input, &flags) || !WireFormat::ReadString(this->input, &value))
+				return false;
+
+			this->settings.emplace_back(name, value);
+		}
+
+		uint64_t stage;
+		uint64_t compression_state;
+
+		if (!WireFormat::ReadUInt64(this->input, &stage) || !WireFormat::ReadUInt64(this->input, &compression_state) || !WireFormat::ReadString(this->input, &query))
+			return false;
+
+		this->compression = (compression_state != 0);
+
+		// External tables are sent as data blocks before the empty one
+		while (true)
+		{
+			Block block;
+			if (!this->receive_data(block))
+				return false;
+
+			if (block.GetColumnCount() == 0)
+				break;
+
+			if (options.verbose)
+				fprintf(stderr, "External table with %lu rows\n", block.GetRowCount());
+		}
+
+		return true;
+	}
+
+	void process_select(const string &query) const
+	{
+		if (options.latency_ms != 0)
+			std::this_thread::sleep_for(std::chrono::milliseconds(options.latency_ms));
+
+		if (contains(query, "fake_settings"))
+		{
+			auto names = make_shared<ColumnString>();
+			auto values = make_shared<ColumnString>();
+
+			for (const auto &[name, value] : this->settings)
+			{
+				names->Append(name);
+				values->Append(value);
+			}
+
+			Block block;
+			block.AppendColumn("name", names);
+			block.AppendColumn("value", values);
+
+			this->send_data(make_block({{"name", "String"}, {"value", "String"}}, 0, 0));
+			if (block.GetRowCount() != 0)
+				this->send_data(block);
+
+			this->send_end_of_query(block.GetRowCount(), 1, 0);
+			return;
+		}
+
+		// Header block with columns and types goes first, like the real server does
+		this->send_data(make_block(schema, 0, 0));
+
+		size_t blocks = 0;
+		size_t bytes = 0;
+
+		for (size_t offset = 0; offset < options.rows; offset += options.block_rows)
+		{
+			if (this->input.has_data())
+			{
+				// Cancel is the only packet client can send during the query
+				if (options.verbose)
+					fprintf(stderr, "Query canceled after %lu rows\n", offset);
+				break;
+			}
+
+			if (blocks != 0 && options.block_latency_ms != 0)
+				std::this_thread::sleep_for(std::chrono::milliseconds(options.block_latency_ms));
+
+			Block block = make_block(schema, std::min(options.block_rows, options.rows - offset), offset);
+
+			this->send_data(block);
+
+			blocks++;
+			bytes += block.GetRowCount() * schema.size() * 8;
+		}
+
+		this->send_end_of_query(options.rows, blocks, bytes);
+	}
+
+	void process_insert(const string &query)
+	{
+		vector<pair<string, string>> columns;
+
+		size_t values = query.find("VALUES");
+		size_t open = query.find('(');
+		size_t close = query.rfind(')', values);
+
+		if (open != string::npos && close != string::npos && open < close)
+		{
+			for (const string &name : split_columns(query.substr(open + 1, close - open - 1)))
+			{
+				auto iter = std::find_if(schema.begin(), schema.end(), [&name] (const auto &column) { return column.first == name; });
+
+				columns.emplace_back(name, iter != schema.end() ? iter->second : "String");
+			}
+		}
+		else
+			columns = schema;
+
+		this->send_data(make_block(columns, 0, 0));
+
+		if (options.latency_ms != 0)
+			std::this_thread::sleep_for(std::chrono::milliseconds(options.latency_ms));
+
+		size_t rows = 0;
+		size_t blocks = 0;
+
+		while (true)
+		{
+			Block block;
+			if (!this->receive_data(block))
+				throw std::runtime_error("Failed to receive insert data");
+
+			if (block.GetColumnCount() == 0)
+				break;
+
+			rows += block.GetRowCount();
+			blocks++;
+		}
+
+		if (options.verbose)
+			fprintf(stderr, "Inserted %lu rows in %lu blocks\n", rows, blocks);
+
+		this->send_end_of_query(0, 0, 0);
+	}
+
+public:
+	explicit Connection(int fd):
+		fd(fd), input(fd), revision(REVISION), compression(false)
+	{}
+
+	~Connection()
+	{
+		close(this->fd);
+	}
+
+	void run()
+	{
+		if (!this->receive_hello())
+			return;
+
+		this->send_hello();
+
+		while (true)
+		{
+			uint64_t packet;
+			if (!WireFormat::ReadUInt64(this->input, &packet))
+				return;
+
+			switch (packet)
+			{
+				case ClientCodes::Ping:
+					this->send_pong();
+					continue;
+				case ClientCodes::Cancel:
+					continue;
+				case ClientCodes::Query:
+					break;
+				default:
+					fprintf(stderr, "Unexpected packet %lu\n", packet);
+					return;
+			}
+
+			string query;
+			if (!this->receive_query(query))
+				return;
+
+			size_t number = ++queries_count;
+
+			if (options.verbose)
+				fprintf(stderr, "Query %lu: %s\n", number, query.c_str());
+
+			if (options.drop_every != 0 && number % options.drop_every == 0)
+				return;
+
+			if (contains(query, "fake_exception") || (options.error_every != 0 && number % options.error_every == 0))
+			{
+				this->send_exception(1000, "Fake server error for query " + std::to_string(number));
+				continue;
+			}
+
+			string prefix = query.substr(query.find_first_not_of(" \t\r\n"), 6);
+			std::transform(prefix.begin(), prefix.end(), prefix.begin(), ::toupper);
+
+			if (prefix == "INSERT")
+				this->process_insert(query);
+			else
+				this->process_select(query);
+		}
+	}
+};
+
+auto parse_options(int argc, char **argv) -> bool
+{
+	for (int i = 1; i < argc; i++)
+	{
+		string name = argv[i];
+
+		if (name == "--verbose")
+		{
+			options.verbose = true;
+			continue;
+		}
+
+		if (i + 1 >= argc)
+			return false;
+
+		const char *value = argv[++i];
+
+		if (name == "--port")
+			options.port = static_cast<uint16_t>(strtoul(value, nullptr, 10));
+		else if (name == "--schema")
+			options.schema = value;
+		else if (name == "--rows")
+			options.rows = strtoul(value, nullptr, 10);
+		else if (name == "--block-rows")
+			options.block_rows = strtoul(value, nullptr, 10);
+		else if (name == "--latency-ms")
+			options.latency_ms = static_cast<unsigned>(strtoul(value, nullptr, 10));
+		else if (name == "--block-latency-ms")
+			options.block_latency_ms = static_cast<unsigned>(strtoul(value, nullptr, 10));
+		else if (name == "--error-every")
+			options.error_every = strtoul(value, nullptr, 10);
+		else if (name == "--drop-every")
+			options.drop_every = strtoul(value, nullptr, 10);
+		else
+			return false;
+	}
+
+	return options.block_rows != 0;
+}
+
+}
+
+auto main(int argc, char **argv) -> int
+{
+	if (!parse_options(argc, argv) || !parse_schema(options.schema))
+	{
+		fprintf(stderr, "Usage: %s [--port 9001] [--schema 'id UInt64, name String'] [--rows 100000] [--block-rows 65536] [--latency-ms 0] [--block-latency-ms 0] [--error-every 0] [--drop-every 0] [--verbose]\n", argv[0]);
+		return 1;
+	}
+
+	signal(SIGPIPE, SIG_IGN);
+
+	int server = socket(AF_INET, SOCK_STREAM, 0);
+
+	int enable = 1;
+	setsockopt(server, SOL_SOCKET, SO_REUSEADDR, &enable, sizeof(enable));
+
+	sockaddr_in address{};
+	address.sin_family = AF_INET;
+	address.sin_port = htons(options.port);
+	address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+	if (bind(server, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0 || listen(server, 128) != 0)
+	{
+		fprintf(stderr, "Failed to listen on 127.0.0.1:%u: %s\n", options.port, strerror(errno));
+		return 1;
+	}
+
+	fprintf(stderr, "Listening on 127.0.0.1:%u\n", options.port);
+
+	while (true)
+	{
+		int client = accept(server, nullptr, nullptr);
+		if (client < 0)
+			continue;
+
+		setsockopt(client, IPPROTO_TCP, TCP_NODELAY, &enable, sizeof(enable));
+
+		std::thread([client]
+		{
+			try
+			{
+				Connection(client).run();
+			}
+			catch (const std::exception &e)
+			{
+				fprintf(stderr, "Connection failed: %s\n", e.what());
+			}
+		}).detach();
+	}
+}
\ No newline at end of file
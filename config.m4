@@ -9,14 +9,27 @@ if test "$CLICKHOUSE" != "no"; then
 	PHP_REQUIRE_CXX()
 	PHP_SUBST(CLICKHOUSE_SHARED_LIBADD)
 	PHP_ADD_LIBRARY(stdc++, 1, CLICKHOUSE_SHARED_LIBADD)
+	PHP_ADD_LIBRARY(pthread, 1, CLICKHOUSE_SHARED_LIBADD)
 
  	CXXFLAGS="-fPIC -mno-sse4.2 -mno-sse4.1 -O2 -g3 -std=gnu++2a -Wall -Wextra -Wdeprecated -Wno-deprecated-declarations -Wno-unused-parameter -Wredundant-decls -Wlogical-op -Wtrampolines -Wduplicated-cond -Wsuggest-override -Wdouble-promotion -Wno-unknown-pragmas -Wcast-qual -fno-omit-frame-pointer -include src/defines.h"
-	LDFLAGS="-fPIC -mno-sse4.2 -mno-sse4.1 -O2 -g3 -Wl,--export-dynamic -fno-omit-frame-pointer"
+	LDFLAGS="-fPIC -mno-sse4.2 -mno-sse4.1 -O2 -g3 -Wl,--export-dynamic -Wl,--wrap=LZ4_decompress_safe -Wl,--wrap=recv -fno-omit-frame-pointer"
 
 	sources="src/clickhouse.cpp \
 		src/util.cpp \
 		src/ClickHouseDB.cpp \
 		src/ClickHouseResult.cpp \
+		src/ClickHouseExport.cpp \
+		src/ClickHouseStats.cpp \
+		src/ClickHousePipeline.cpp \
+		src/ClickHouseAsyncWriter.cpp \
+		src/ClickHouseCache.cpp \
+		src/ClickHouseCodec.cpp \
+		src/ClickHouseBlockStore.cpp \
+		src/ClickHouseSlowLog.cpp \
+		src/ClickHouseParallelQuery.cpp \
+		src/lz4_dispatch.cpp \
+		src/lz4_sse42.cpp \
+		src/lz4_avx2.cpp \
 		clickhouse-cpp/clickhouse/block.cpp \
 		clickhouse-cpp/clickhouse/client.cpp \
 		clickhouse-cpp/clickhouse/query.cpp \
@@ -0,0 +1,231 @@
+#include "ClickHouseAsyncWriter.h"
+#include "probes.h"
+
+#include <pthread.h>
+
+ClickHouseAsyncWriter::ClickHouseAsyncWriter(const ClientOptions &options, const Config &config):
+	options(options), config(config), pending_rows(0), stopping(false), sent_rows(0), dropped_rows(0), errors(0)
+{
+	this->thread = std::thread(&ClickHouseAsyncWriter::run, this);
+}
+
+ClickHouseAsyncWriter::~ClickHouseAsyncWriter()
+{
+	this->stop();
+}
+
+void ClickHouseAsyncWriter::run()
+{
+	std::unique_ptr<Client> client;
+
+	std::unique_lock lock(this->mutex);
+
+	while (true)
+	{
+		this->condition.wait_for(lock, this->config.flush_interval, [this]
+		{
+			return this->stopping || this->pending_rows >= this->config.flush_rows;
+		});
+
+		auto now = std::chrono::steady_clock::now();
+
+		// Rows of several queries can reach the limit together while each of them is below it, all of them are sent then,
+		// otherwise the thread would wake up right away again without sending anything
+		bool flush_all = this->stopping || this->pending_rows >= this->config.flush_rows;
+
+		vector<pair<string, Block>> ready;
+		for (auto iter = this->pending.begin(); iter != this->pending.end();)
+		{
+			if (!flush_all && now - iter->second.created < this->config.flush_interval)
+			{
+				++iter;
+				continue;
+			}
+
+			this->pending_rows -= iter->second.block.GetRowCount();
+
+			ready.emplace_back(iter->first, std::move(iter->second.block));
+			iter = this->pending.erase(iter);
+		}
+
+		bool stop = this->stopping;
+
+		if (!ready.empty())
+		{
+			lock.unlock();
+
+			for (auto &[query, block] : ready)
+			{
+				try
+				{
+					if (!client)
+						client = std::make_unique<Client>(this->options);
+
+					this->flush(*client, query, block);
+				}
+				catch (std::exception&)
+				{
+					CLICKHOUSE_PROBE(insert__done, block.GetRowCount(), 1);
+
+					this->errors++;
+					this->dropped_rows += block.GetRowCount();
+
+					// Connection state is unknown after a failure, the next flush reconnects
+					client.reset();
+				}
+			}
+
+			lock.lock();
+		}
+
+		if (stop)
+			break;
+	}
+}
+
+void ClickHouseAsyncWriter::flush(Client &client, const string &query, const Block &block)
+{
+	CLICKHOUSE_PROBE(insert__start, query.c_str(), block.GetRowCount());
+
+	client.InsertQuery(query, [] (const Block&)
+	{});
+	client.InsertData(block);
+
+	CLICKHOUSE_PROBE(insert__done, block.GetRowCount(), 0);
+
+	this->sent_rows += block.GetRowCount();
+}
+
+auto ClickHouseAsyncWriter::get_description(const string &query, Block &description) -> bool
+{
+	std::lock_guard lock(this->mutex);
+
+	auto iter = this->descriptions.find(query);
+	if (iter == this->descriptions.end())
+		return false;
+
+	description = iter->second;
+	return true;
+}
+
+void ClickHouseAsyncWriter::set_description(const string &query, const Block &description)
+{
+	std::lock_guard lock(this->mutex);
+
+	this->descriptions[query] = description;
+}
+
+auto ClickHouseAsyncWriter::push(const string &query, const Block &block) -> bool
+{
+	size_t rows = block.GetRowCount();
+
+	std::lock_guard lock(this->mutex);
+
+	if (this->stopping || this->pending_rows + rows > this->config.max_rows)
+	{
+		this->dropped_rows += rows;
+		return false;
+	}
+
+	auto [iter, inserted] = this->pending.try_emplace(query);
+	if (inserted)
+	{
+		iter->second.block = block;
+		iter->second.created = std::chrono::steady_clock::now();
+	}
+	else
+	{
+		Block &pending_block = iter->second.block;
+
+		for (size_t i = 0; i < pending_block.GetColumnCount(); i++)
+			pending_block[i]->Append(block[i]);
+
+		pending_block.RefreshRowCount();
+	}
+
+	this->pending_rows += rows;
+
+	if (this->pending_rows >= this->config.flush_rows)
+		this->condition.notify_all();
+
+	return true;
+}
+
+void ClickHouseAsyncWriter::stop()
+{
+	{
+		std::lock_guard lock(this->mutex);
+		this->stopping = true;
+	}
+
+	this->condition.notify_all();
+
+	if (this->thread.joinable())
+		this->thread.join();
+}
+
+auto ClickHouseAsyncWriter::get(const ClientOptions &options, const Config &config) -> ClickHouseAsyncWriter*
+{
+	string key = options.host + ":" + std::to_string(options.port) + "/" + options.default_database + "/" + options.user;
+
+	std::lock_guard lock(writers_mutex);
+
+	if (!fork_handler_registered)
+	{
+		pthread_atfork(nullptr, nullptr, &ClickHouseAsyncWriter::forget_all);
+		fork_handler_registered = true;
+	}
+
+	auto &writer = writers[key];
+	if (!writer)
+		writer = std::make_unique<ClickHouseAsyncWriter>(options, config);
+
+	return writer.get();
+}
+
+void ClickHouseAsyncWriter::forget_all()
+{
+	// Child of a fork has the writers but not their threads, and their mutexes can be locked by threads that are gone.
+	// Writers are leaked without joining, pending rows belong to the parent and are sent by it, the child starts new ones.
+	new (&writers_mutex) std::mutex();
+
+	for (auto &[key, writer] : writers)
+		(void)writer.release();
+
+	writers.clear();
+}
+
+void ClickHouseAsyncWriter::stop_all()
+{
+	std::lock_guard lock(writers_mutex);
+
+	// Destructors flush the rest of pending rows
+	writers.clear();
+}
+
+void ClickHouseAsyncWriter::add_stats(zval *array)
+{
+	uint64_t sent = 0;
+	uint64_t dropped = 0;
+	uint64_t failed = 0;
+	uint64_t pending = 0;
+
+	{
+		std::lock_guard lock(writers_mutex);
+
+		for (auto &[key, writer] : writers)
+		{
+			sent += writer->sent_rows;
+			dropped += writer->dropped_rows;
+			failed += writer->errors;
+
+			std::lock_guard writer_lock(writer->mutex);
+			pending += writer->pending_rows;
+		}
+	}
+
+	add_assoc_long(array, "async_sent_rows", static_cast<zend_long>(sent));
+	add_assoc_long(array, "async_dropped_rows", static_cast<zend_long>(dropped));
+	add_assoc_long(array, "async_errors", static_cast<zend_long>(failed));
+	add_assoc_long(array, "async_pending_rows", static_cast<zend_long>(pending));
+}
\ No newline at end of file
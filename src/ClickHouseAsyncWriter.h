@@ -0,0 +1,73 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+// Per-process buffer of rows inserted with insert_async(), flushed by a background thread by size or age.
+// Rows are converted to blocks in PHP thread, the thread itself works only with clickhouse-cpp and never calls Zend API.
+class ClickHouseAsyncWriter
+{
+public:
+	struct Config
+	{
+		size_t flush_rows;
+		std::chrono::milliseconds flush_interval;
+		size_t max_rows;
+	};
+
+private:
+	struct Pending
+	{
+		Block block;
+		std::chrono::steady_clock::time_point created;
+	};
+
+	inline static std::mutex writers_mutex;
+	inline static unordered_map<string, std::unique_ptr<ClickHouseAsyncWriter>> writers;
+	inline static bool fork_handler_registered = false;
+
+	ClientOptions options;
+	Config config;
+
+	std::mutex mutex;
+	std::condition_variable condition;
+
+	// Keyed by INSERT query, so blocks with the same columns are merged
+	unordered_map<string, Pending> pending;
+	unordered_map<string, Block> descriptions;
+
+	size_t pending_rows;
+	bool stopping;
+
+	std::atomic<uint64_t> sent_rows;
+	std::atomic<uint64_t> dropped_rows;
+	std::atomic<uint64_t> errors;
+
+	std::thread thread;
+
+	void run();
+	void flush(Client &client, const string &query, const Block &block);
+
+	static void forget_all();
+
+public:
+	ClickHouseAsyncWriter(const ClientOptions &options, const Config &config);
+	~ClickHouseAsyncWriter();
+
+	ClickHouseAsyncWriter(const ClickHouseAsyncWriter&) = delete;
+	auto operator=(const ClickHouseAsyncWriter&) -> ClickHouseAsyncWriter& = delete;
+
+	[[nodiscard]] auto get_description(const string &query, Block &description) -> bool;
+	void set_description(const string &query, const Block &description);
+
+	// False if the buffer is full and rows are dropped
+	[[nodiscard]] auto push(const string &query, const Block &block) -> bool;
+
+	void stop();
+
+	[[nodiscard]] static auto get(const ClientOptions &options, const Config &config) -> ClickHouseAsyncWriter*;
+	static void stop_all();
+	static void add_stats(zval *array);
+};
\ No newline at end of file
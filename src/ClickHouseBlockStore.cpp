@@ -0,0 +1,192 @@
+#include "ClickHouseBlockStore.h"
+
+#include "ClickHouseCodec.h"
+#include "probes.h"
+#include "lz4_dispatch.h"
+
+#include "contrib/lz4/lz4/lz4.h"
+
+#include <main/php_open_temporary_file.h>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+ClickHouseBlockStore::ClickHouseBlockStore(bool compressed):
+	compressed(compressed), fd(-1), write_failed(false), file_size(0), memory_size(0)
+{}
+
+ClickHouseBlockStore::~ClickHouseBlockStore()
+{
+	if (this->fd != -1)
+		close(this->fd);
+}
+
+auto ClickHouseBlockStore::open_file() -> bool
+{
+	const char *directory = php_get_temporary_directory();
+
+	// File without a name is removed by the kernel when closed, even if the process is killed
+	this->fd = open(directory, O_TMPFILE | O_RDWR | O_CLOEXEC, 0600);
+	if (this->fd != -1)
+		return true;
+
+	// Older kernels and some file systems have no O_TMPFILE, named file is unlinked right away
+	string path(directory);
+	path.append("/clickhouse-spill-XXXXXX");
+
+	this->fd = mkostemp(path.data(), O_CLOEXEC);
+	if (this->fd == -1)
+	{
+		zend_error(E_WARNING, "Failed to create temporary file in %s for result blocks: %s", directory, strerror(errno));
+		return false;
+	}
+
+	unlink(path.c_str());
+	return true;
+}
+
+auto ClickHouseBlockStore::is_spilled() const -> bool
+{
+	return this->fd != -1;
+}
+
+auto ClickHouseBlockStore::write_all(const Buffer &buffer) -> bool
+{
+	size_t written = 0;
+	while (written < buffer.size())
+	{
+		ssize_t result = pwrite(this->fd, buffer.data() + written, buffer.size() - written, static_cast<off_t>(this->file_size + written));
+		if (result == -1 && errno == EINTR)
+			continue;
+
+		if (result <= 0)
+			return false;
+
+		written += static_cast<size_t>(result);
+	}
+
+	return true;
+}
+
+void ClickHouseBlockStore::push(const Block &block)
+{
+	Buffer buffer;
+	{
+		BufferOutput output(&buffer);
+		ClickHouseCodec::write_block(output, block);
+		output.Flush();
+	}
+
+	uint64_t raw_length = 0;
+	if (this->compressed && buffer.size() <= LZ4_MAX_INPUT_SIZE)
+	{
+		int bound = LZ4_compressBound(static_cast<int>(buffer.size()));
+		this->scratch.resize(static_cast<size_t>(bound));
+
+		int length = LZ4_compress_default(reinterpret_cast<const char*>(buffer.data()), reinterpret_cast<char*>(this->scratch.data()), static_cast<int>(buffer.size()), bound);
+
+		// Incompressible block is kept as is
+		if (length > 0 && static_cast<size_t>(length) < buffer.size())
+		{
+			raw_length = buffer.size();
+			buffer = Buffer(this->scratch.begin(), this->scratch.begin() + length);
+		}
+	}
+
+	if (this->fd != -1 && !this->write_failed)
+	{
+		if (this->write_all(buffer))
+		{
+			this->entries.push_back({this->file_size, buffer.size(), raw_length, {}});
+			this->file_size += buffer.size();
+			return;
+		}
+
+		this->write_failed = true;
+		zend_error(E_WARNING, "Failed to write result block to temporary file, the rest of the result is kept in memory: %s", strerror(errno));
+	}
+
+	this->memory_size += buffer.size();
+	this->entries.push_back({0, buffer.size(), raw_length, std::move(buffer)});
+}
+
+auto ClickHouseBlockStore::decode(const uint8_t *data, size_t length, uint64_t raw_length, Block &block) -> bool
+{
+	if (raw_length != 0)
+	{
+		this->scratch.resize(static_cast<size_t>(raw_length));
+
+		if (lz4_decompress_safe(reinterpret_cast<const char*>(data), reinterpret_cast<char*>(this->scratch.data()), static_cast<int>(length), static_cast<int>(raw_length)) != static_cast<int>(raw_length))
+		{
+			zend_error(E_WARNING, "Failed to decompress result block");
+			return false;
+		}
+
+		CLICKHOUSE_PROBE(block__decompress, length, raw_length);
+
+		data = this->scratch.data();
+		length = static_cast<size_t>(raw_length);
+	}
+
+	ArrayInput input(data, length);
+	if (!ClickHouseCodec::read_block(input, block))
+	{
+		zend_error(E_WARNING, "Failed to read result block");
+		return false;
+	}
+
+	block.RefreshRowCount();
+	return true;
+}
+
+auto ClickHouseBlockStore::pop(Block &block) -> bool
+{
+	if (this->entries.empty())
+		return false;
+
+	Entry entry = std::move(this->entries.front());
+	this->entries.pop_front();
+
+	if (!entry.data.empty())
+	{
+		this->memory_size -= entry.data.size();
+		return this->decode(entry.data.data(), entry.data.size(), entry.raw_length, block);
+	}
+
+	static const auto page_size = static_cast<uint64_t>(sysconf(_SC_PAGESIZE));
+
+	uint64_t map_offset = entry.offset & ~(page_size - 1);
+	size_t map_length = static_cast<size_t>(entry.offset + entry.length - map_offset);
+
+	void *memory = mmap(nullptr, map_length, PROT_READ, MAP_PRIVATE, this->fd, static_cast<off_t>(map_offset));
+	if (memory == MAP_FAILED)
+	{
+		zend_error(E_WARNING, "Failed to map result block from temporary file: %s", strerror(errno));
+		return false;
+	}
+
+	bool success = this->decode(static_cast<const uint8_t*>(memory) + (entry.offset - map_offset), static_cast<size_t>(entry.length), entry.raw_length, block);
+
+	munmap(memory, map_length);
+
+	// Read pages are not needed anymore, no reason to keep them in page cache
+	posix_fadvise(this->fd, static_cast<off_t>(map_offset), static_cast<off_t>(map_length), POSIX_FADV_DONTNEED);
+
+	return success;
+}
+
+auto ClickHouseBlockStore::get_size() const -> uint64_t
+{
+	return this->file_size;
+}
+
+auto ClickHouseBlockStore::get_memory_size() const -> uint64_t
+{
+	return this->memory_size;
+}
+
+auto ClickHouseBlockStore::get_count() const -> size_t
+{
+	return this->entries.size();
+}
\ No newline at end of file
@@ -0,0 +1,52 @@
+#pragma once
+
+// Blocks of a buffered result kept serialized until fetch reaches them, optionally LZ4 compressed. They are held in
+// memory until the file is opened, later ones go to an unlinked temporary file and are mapped back one by one.
+// Blocks are read in the same order they were written.
+class ClickHouseBlockStore
+{
+private:
+	struct Entry
+	{
+		// Offset and length in the file, data is empty then
+		uint64_t offset;
+		uint64_t length;
+
+		// Length before compression, 0 if the block is not compressed
+		uint64_t raw_length;
+
+		Buffer data;
+	};
+
+	bool compressed;
+
+	int fd;
+	bool write_failed;
+	uint64_t file_size;
+	uint64_t memory_size;
+
+	deque<Entry> entries;
+
+	// Compression and decompression output, reused between blocks
+	Buffer scratch;
+
+	[[nodiscard]] auto write_all(const Buffer &buffer) -> bool;
+	[[nodiscard]] auto decode(const uint8_t *data, size_t length, uint64_t raw_length, Block &block) -> bool;
+
+public:
+	explicit ClickHouseBlockStore(bool compressed);
+	~ClickHouseBlockStore();
+
+	ClickHouseBlockStore(const ClickHouseBlockStore&) = delete;
+	auto operator=(const ClickHouseBlockStore&) -> ClickHouseBlockStore& = delete;
+
+	[[nodiscard]] auto open_file() -> bool;
+	[[nodiscard]] auto is_spilled() const -> bool;
+
+	void push(const Block &block);
+	[[nodiscard]] auto pop(Block &block) -> bool;
+
+	[[nodiscard]] auto get_size() const -> uint64_t;
+	[[nodiscard]] auto get_memory_size() const -> uint64_t;
+	[[nodiscard]] auto get_count() const -> size_t;
+};
\ No newline at end of file
@@ -0,0 +1,296 @@
+#include "ClickHouseCache.h"
+
+#include <sys/mman.h>
+
+auto ClickHouseCache::create(size_t size) -> bool
+{
+	if (size <= sizeof(Header) + PARTITIONS * 1024)
+		return false;
+
+	void *memory = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+	if (memory == MAP_FAILED)
+	{
+		zend_error(E_WARNING, "Failed to map %zu bytes of shared memory for query cache: %s", size, strerror(errno));
+		return false;
+	}
+
+	header = static_cast<Header*>(memory);
+	memory_size = size;
+
+	// Pages are zeroed by the kernel, all slots are empty
+	header->data_size = ((size - sizeof(Header)) / PARTITIONS) & ~static_cast<uint64_t>(7);
+
+	pthread_mutexattr_t attr;
+	pthread_mutexattr_init(&attr);
+	pthread_mutexattr_setpshared(&attr, PTHREAD_PROCESS_SHARED);
+	pthread_mutexattr_setrobust(&attr, PTHREAD_MUTEX_ROBUST);
+
+	for (Partition &partition : header->partitions)
+		pthread_mutex_init(&partition.mutex, &attr);
+
+	pthread_mutexattr_destroy(&attr);
+	return true;
+}
+
+void ClickHouseCache::destroy()
+{
+	if (header == nullptr)
+		return;
+
+	munmap(header, memory_size);
+
+	header = nullptr;
+	memory_size = 0;
+}
+
+auto ClickHouseCache::is_enabled() -> bool
+{
+	return header != nullptr;
+}
+
+auto ClickHouseCache::get_data(size_t partition) -> uint8_t*
+{
+	return reinterpret_cast<uint8_t*>(header) + sizeof(Header) + partition * header->data_size;
+}
+
+auto ClickHouseCache::lock(Partition &partition) -> bool
+{
+	int result = pthread_mutex_lock(&partition.mutex);
+	if (result == 0)
+		return true;
+
+	if (result != EOWNERDEAD)
+		return false;
+
+	// Process died while holding the lock, entries of the partition can be half-written
+	clear(partition);
+	pthread_mutex_consistent(&partition.mutex);
+	return true;
+}
+
+void ClickHouseCache::clear(Partition &partition)
+{
+	partition.write_offset = 0;
+
+	for (Slot &slot : partition.slots)
+		slot.length = 0;
+}
+
+auto ClickHouseCache::make_key(const ClientOptions &options, const ServerSettings &settings, const string &query) -> string
+{
+	string key;
+	key.reserve(query.size() + 128);
+
+	key.append(options.host);
+	key.push_back('\0');
+	key.append(std::to_string(options.port));
+	key.push_back('\0');
+	key.append(options.default_database);
+	key.push_back('\0');
+	key.append(options.user);
+	key.push_back('\0');
+
+	for (const auto &[name, value] : settings)
+	{
+		key.append(name);
+		key.push_back('=');
+		key.append(value);
+		key.push_back('\0');
+	}
+
+	key.push_back('\0');
+
+	append_normalized(key, query);
+	return key;
+}
+
+void ClickHouseCache::append_normalized(string &key, const string &query)
+{
+	// Whitespace is trimmed and collapsed outside of string literals and quoted identifiers
+	char quote = 0;
+	bool space = false;
+
+	for (size_t i = 0; i < query.size(); i++)
+	{
+		char c = query[i];
+
+		if (quote != 0)
+		{
+			key.push_back(c);
+
+			if (c == '\\' && i + 1 < query.size())
+				key.push_back(query[++i]);
+			else if (c == quote)
+				quote = 0;
+
+			continue;
+		}
+
+		if (c == ' ' || c == '\t' || c == '\n' || c == '\r')
+		{
+			space = true;
+			continue;
+		}
+
+		if (space && !key.empty() && key.back() != '\0')
+			key.push_back(' ');
+		space = false;
+
+		if (c == '\'' || c == '"' || c == '`')
+			quote = c;
+
+		key.push_back(c);
+	}
+}
+
+auto ClickHouseCache::get(const string &key, Buffer &value) -> bool
+{
+	if (header == nullptr)
+		return false;
+
+	uint64_t hash = std::hash<string>{}(key);
+
+	size_t number = hash % PARTITIONS;
+	Partition &partition = header->partitions[number];
+	const uint8_t *data = get_data(number);
+
+	size_t first = (hash / PARTITIONS) % (SLOTS / WAYS) * WAYS;
+	uint64_t now = ClickHouseStats::now();
+
+	if (!lock(partition))
+		return false;
+
+	bool found = false;
+
+	for (size_t i = first; i < first + WAYS; i++)
+	{
+		Slot &slot = partition.slots[i];
+		if (slot.length == 0 || slot.hash != hash || slot.key_length != key.size() || memcmp(data + slot.offset, key.data(), key.size()) != 0)
+			continue;
+
+		if (slot.expires <= now)
+		{
+			slot.length = 0;
+			break;
+		}
+
+		value.assign(data + slot.offset + slot.key_length, data + slot.offset + slot.length);
+		found = true;
+		break;
+	}
+
+	pthread_mutex_unlock(&partition.mutex);
+	return found;
+}
+
+void ClickHouseCache::put(const string &key, const Buffer &value, uint64_t ttl)
+{
+	if (header == nullptr)
+		return;
+
+	uint64_t length = key.size() + value.size();
+
+	// Entry larger than a quarter of partition would evict almost everything
+	if (length > header->data_size / 4)
+		return;
+
+	uint64_t hash = std::hash<string>{}(key);
+
+	size_t number = hash % PARTITIONS;
+	Partition &partition = header->partitions[number];
+	uint8_t *data = get_data(number);
+
+	size_t first = (hash / PARTITIONS) % (SLOTS / WAYS) * WAYS;
+	uint64_t now = ClickHouseStats::now();
+
+	if (!lock(partition))
+		return;
+
+	if (partition.write_offset + length > header->data_size)
+		partition.write_offset = 0;
+
+	uint64_t start = partition.write_offset;
+	uint64_t end = start + length;
+
+	for (Slot &slot : partition.slots)
+	{
+		if (slot.length == 0 || slot.offset >= end || slot.offset + slot.length <= start)
+			continue;
+
+		slot.length = 0;
+		partition.evictions++;
+	}
+
+	Slot *target = nullptr;
+
+	for (size_t i = first; i < first + WAYS; i++)
+	{
+		Slot &slot = partition.slots[i];
+
+		// The same key is replaced, otherwise empty or expired slot is taken, otherwise the one expiring first
+		if (slot.length != 0 && slot.hash == hash && slot.key_length == key.size() && memcmp(data + slot.offset, key.data(), key.size()) == 0)
+		{
+			target = &slot;
+			break;
+		}
+
+		if (target == nullptr || slot.length == 0 || slot.expires <= now || (target->length != 0 && target->expires > now && slot.expires < target->expires))
+			target = &slot;
+	}
+
+	if (target->length != 0 && target->expires > now && !(target->hash == hash && target->key_length == key.size()))
+		partition.evictions++;
+
+	memcpy(data + start, key.data(), key.size());
+	memcpy(data + start + key.size(), value.data(), value.size());
+
+	target->hash = hash;
+	target->offset = start;
+	target->key_length = key.size();
+	target->length = length;
+	target->expires = now + ttl;
+
+	partition.write_offset = end;
+	partition.stores++;
+
+	pthread_mutex_unlock(&partition.mutex);
+}
+
+void ClickHouseCache::add_stats(zval *array)
+{
+	if (header == nullptr)
+		return;
+
+	uint64_t stores = 0;
+	uint64_t evictions = 0;
+	uint64_t entries = 0;
+	uint64_t used = 0;
+
+	uint64_t now = ClickHouseStats::now();
+
+	for (Partition &partition : header->partitions)
+	{
+		if (!lock(partition))
+			continue;
+
+		stores += partition.stores;
+		evictions += partition.evictions;
+
+		for (const Slot &slot : partition.slots)
+		{
+			if (slot.length == 0 || slot.expires <= now)
+				continue;
+
+			entries++;
+			used += slot.length;
+		}
+
+		pthread_mutex_unlock(&partition.mutex);
+	}
+
+	add_assoc_long(array, "cache_stores", static_cast<zend_long>(stores));
+	add_assoc_long(array, "cache_evictions", static_cast<zend_long>(evictions));
+	add_assoc_long(array, "cache_entries", static_cast<zend_long>(entries));
+	add_assoc_long(array, "cache_used_bytes", static_cast<zend_long>(used));
+	add_assoc_long(array, "cache_size", static_cast<zend_long>(memory_size));
+}
\ No newline at end of file
@@ -0,0 +1,68 @@
+#pragma once
+
+#include "util.h"
+
+#include <pthread.h>
+
+// Query results shared by all processes of the server: shared memory is mapped in MINIT before FPM forks workers.
+// Memory is split into partitions with own robust process-shared mutex, each partition stores entries in a ring buffer,
+// new entries overwrite the oldest ones, slots of an entry are chosen in a small set by the key hash.
+class ClickHouseCache
+{
+private:
+	static constexpr size_t PARTITIONS = 16;
+	static constexpr size_t SLOTS = 1024;
+	static constexpr size_t WAYS = 4;
+
+	struct Slot
+	{
+		uint64_t hash;
+		uint64_t offset;
+		uint64_t key_length;
+		// Zero for empty slot
+		uint64_t length;
+		uint64_t expires;
+	};
+
+	struct Partition
+	{
+		pthread_mutex_t mutex;
+
+		uint64_t write_offset;
+
+		uint64_t stores;
+		uint64_t evictions;
+
+		Slot slots[SLOTS];
+	};
+
+	struct Header
+	{
+		uint64_t data_size;
+
+		Partition partitions[PARTITIONS];
+	};
+
+	inline static Header *header = nullptr;
+	inline static size_t memory_size = 0;
+
+	[[nodiscard]] static auto get_data(size_t partition) -> uint8_t*;
+
+	[[nodiscard]] static auto lock(Partition &partition) -> bool;
+	static void clear(Partition &partition);
+
+	static void append_normalized(string &key, const string &query);
+
+public:
+	[[nodiscard]] static auto create(size_t size) -> bool;
+	static void destroy();
+
+	[[nodiscard]] static auto is_enabled() -> bool;
+
+	[[nodiscard]] static auto make_key(const ClientOptions &options, const ServerSettings &settings, const string &query) -> string;
+
+	[[nodiscard]] static auto get(const string &key, Buffer &value) -> bool;
+	static void put(const string &key, const Buffer &value, uint64_t ttl);
+
+	static void add_stats(zval *array);
+};
\ No newline at end of file
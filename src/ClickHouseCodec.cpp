@@ -0,0 +1,143 @@
+#include "ClickHouseCodec.h"
+
+#include "clickhouse/base/wire_format.h"
+#include "clickhouse/columns/factory.h"
+
+class CountingOutput : public OutputStream
+{
+private:
+	size_t size = 0;
+
+protected:
+	auto DoWrite([[maybe_unused]] const void *data, size_t len) -> size_t override
+	{
+		this->size += len;
+		return len;
+	}
+
+public:
+	[[nodiscard]] auto get_size() const -> size_t
+	{
+		return this->size;
+	}
+};
+
+void ClickHouseCodec::write_block(OutputStream &output, const Block &block)
+{
+	WireFormat::WriteUInt64(output, block.GetColumnCount());
+	WireFormat::WriteUInt64(output, block.GetRowCount());
+
+	for (size_t i = 0; i < block.GetColumnCount(); i++)
+	{
+		WireFormat::WriteString(output, block.GetColumnName(i));
+		WireFormat::WriteString(output, block[i]->Type()->GetName());
+
+		if (block.GetRowCount() != 0)
+			block[i]->Save(&output);
+	}
+}
+
+auto ClickHouseCodec::read_block(InputStream &input, Block &block) -> bool
+{
+	uint64_t columns;
+	uint64_t rows;
+
+	if (!WireFormat::ReadUInt64(input, &columns) || !WireFormat::ReadUInt64(input, &rows))
+		return false;
+
+	for (uint64_t i = 0; i < columns; i++)
+	{
+		string name;
+		string type;
+
+		if (!WireFormat::ReadString(input, &name) || !WireFormat::ReadString(input, &type))
+			return false;
+
+		ColumnRef column = CreateColumnByType(type);
+		if (column == nullptr || (rows != 0 && !column->Load(&input, rows)))
+			return false;
+
+		block.AppendColumn(name, column);
+	}
+
+	return true;
+}
+
+static auto estimate_column_size(const ColumnRef &column) -> size_t
+{
+	switch (column->Type()->GetCode())
+	{
+		case Type::Code::String:
+		{
+			auto strings = column->As<ColumnString>();
+
+			// One byte of length for each value, exact for values shorter than 128 bytes
+			size_t size = strings->Size();
+			for (size_t i = 0; i < strings->Size(); i++)
+				size += strings->At(i).size();
+
+			return size;
+		}
+		case Type::Code::Nullable:
+		{
+			auto nullable = column->As<ColumnNullable>();
+
+			return nullable->Size() + estimate_column_size(nullable->Nested());
+		}
+		default:
+		{
+			// Fixed-size columns are saved by a single write
+			CountingOutput output;
+			column->Save(&output);
+
+			return output.get_size();
+		}
+	}
+}
+
+auto ClickHouseCodec::estimate_size(const Block &block) -> size_t
+{
+	if (block.GetRowCount() == 0)
+		return 0;
+
+	size_t size = 0;
+	for (size_t i = 0; i < block.GetColumnCount(); i++)
+		size += estimate_column_size(block[i]);
+
+	return size;
+}
+
+void ClickHouseCodec::write_blocks(Buffer &buffer, const Buffer &blocks_data, size_t blocks_count, size_t rows_count)
+{
+	BufferOutput output(&buffer);
+
+	WireFormat::WriteUInt64(output, rows_count);
+	WireFormat::WriteUInt64(output, blocks_count);
+
+	output.Write(blocks_data.data(), blocks_data.size());
+	output.Flush();
+}
+
+auto ClickHouseCodec::read_blocks(const uint8_t *data, size_t size, deque<Block> &blocks, size_t &rows_count) -> bool
+{
+	ArrayInput input(data, size);
+
+	uint64_t rows;
+	uint64_t count;
+
+	if (!WireFormat::ReadUInt64(input, &rows) || !WireFormat::ReadUInt64(input, &count))
+		return false;
+
+	for (uint64_t i = 0; i < count; i++)
+	{
+		Block block;
+		if (!ClickHouseCodec::read_block(input, block))
+			return false;
+
+		block.RefreshRowCount();
+		blocks.push_back(std::move(block));
+	}
+
+	rows_count = rows;
+	return true;
+}
\ No newline at end of file
@@ -0,0 +1,19 @@
+#pragma once
+
+#include "clickhouse/base/input.h"
+#include "clickhouse/base/output.h"
+
+// Blocks in native format for keeping them outside of clickhouse-cpp, without block info and compression
+class ClickHouseCodec
+{
+public:
+	static void write_block(OutputStream &output, const Block &block);
+	[[nodiscard]] static auto read_block(InputStream &input, Block &block) -> bool;
+
+	// Close to the size of serialized columns, String values are summed from their lengths instead of being written one by one
+	[[nodiscard]] static auto estimate_size(const Block &block) -> size_t;
+
+	// Whole result: rows count and all blocks, written one by one with write_block() as they are received
+	static void write_blocks(Buffer &buffer, const Buffer &blocks_data, size_t blocks_count, size_t rows_count);
+	[[nodiscard]] static auto read_blocks(const uint8_t *data, size_t size, deque<Block> &blocks, size_t &rows_count) -> bool;
+};
\ No newline at end of file
@@ -1,23 +1,14 @@
 #include "ClickHouseDB.h"
 
 #include "ClickHouseResult.h"
+#include "ClickHouseCodec.h"
+#include "probes.h"
 
-__inline static auto clickhouse_result_new(deque<Block> blocks, size_t rows_count, long int timezone_offset) -> zend_object *
-{
-	auto obj = static_cast<ClickHouseResultObject*>(zend_object_alloc(sizeof(ClickHouseResultObject), clickhouse_result_class_entry));
-
-	zend_object_std_init(&obj->std, clickhouse_result_class_entry);
-	object_properties_init(&obj->std, clickhouse_result_class_entry);
-
-	obj->std.handlers = &clickhouse_object_result_handlers;
-
-	obj->impl = new ClickHouseResult(&obj->std, std::move(blocks), rows_count, timezone_offset);
-
-	return &obj->std;
-}
+#include <sys/eventfd.h>
+#include <unistd.h>
 
 ClickHouseDB::ClickHouseDB(zend_object *zend_this):
-	zend_this(zend_this)
+	zend_this(zend_this), type_mapping(0), stats(make_shared<ClickHouseStats>()), notify_fd(-1)
 {
 	time_t value = 0;
 	tm tm_time{};
@@ -26,8 +17,20 @@ ClickHouseDB::ClickHouseDB(zend_object *zend_this):
 	this->timezone_offset = tm_time.tm_gmtoff;
 }
 
-void ClickHouseDB::connect(const zend_string *host, const zend_string *username, const zend_string *passwd, const zend_string *dbname, zend_long port)
+ClickHouseDB::~ClickHouseDB()
+{
+	// Pipeline thread writes to the event counter until it is joined
+	this->pending.reset();
+
+	if (this->notify_fd != -1)
+		close(this->notify_fd);
+}
+
+void ClickHouseDB::connect(const zend_string *host, const zend_string *username, const zend_string *passwd, const zend_string *dbname, zend_long port, zend_array *connection_settings)
 {
+	if (connection_settings != nullptr && !ClickHouseDB::parse_settings(connection_settings, this->settings))
+		return;
+
 	ClientOptions options;
 	if (host != nullptr)
 		options.SetHost(string(ZSTR_VAL(host), ZSTR_LEN(host)));
@@ -56,6 +59,12 @@ void ClickHouseDB::connect(const zend_string *host, const zend_string *username,
 
 	options.SetCompressionMethod(CompressionMethod::LZ4);
 
+	this->options = options;
+
+	clickhouse_stats_add(this->stats.get(), &ClickHouseStats::connects, 1);
+
+	ClickHouseTimer timer(this->stats.get(), &ClickHouseStats::connect_time);
+
 	try
 	{
 		this->client = make_shared<Client>(options);
@@ -64,10 +73,12 @@ void ClickHouseDB::connect(const zend_string *host, const zend_string *username,
 	{
 		zend_error(E_WARNING, "Failed to connect to ClickHouse: %s", e.what());
 		this->client.reset();
+
+		clickhouse_stats_add(this->stats.get(), &ClickHouseStats::errors, 1);
 	}
 }
 
-auto ClickHouseDB::query(const string &query, bool &success) const -> zend_object*
+auto ClickHouseDB::query(const string &query, zend_long resultmode, zend_array *query_settings, zend_long cache_ttl, zend_array *external_tables, bool &success) const -> zend_object*
 {
 	this->set_error(0, "");
 	this->set_affected_rows(0);
@@ -75,14 +86,118 @@ auto ClickHouseDB::query(const string &query, bool &success) const -> zend_objec
 	if (!this->is_connected())
 		return nullptr;
 
+	resultmode |= this->type_mapping;
+
+	ServerSettings settings = this->settings;
+	if (query_settings != nullptr && !ClickHouseDB::parse_settings(query_settings, settings))
+	{
+		success = false;
+		return nullptr;
+	}
+
+	ExternalTables tables;
+	if (external_tables != nullptr && !ClickHouseDB::parse_external_tables(external_tables, tables))
+	{
+		success = false;
+		return nullptr;
+	}
+
+	// External data is sent by a client call taking only the query text, settings go to SETTINGS clause
+	string query_text(query);
+	if (!tables.empty())
+	{
+		while (!query_text.empty() && string_view(" \t\r\n;").find(query_text.back()) != string_view::npos)
+			query_text.pop_back();
+
+		append_settings(query_text, settings);
+		settings.clear();
+
+		for (const ExternalTable &table : tables)
+		{
+			clickhouse_stats_add(this->stats.get(), &ClickHouseStats::rows_sent, table.data.GetRowCount());
+			clickhouse_stats_add(this->stats.get(), &ClickHouseStats::bytes_sent, ClickHouseCodec::estimate_size(table.data));
+		}
+		clickhouse_stats_add(this->stats.get(), &ClickHouseStats::blocks_sent, tables.size());
+	}
+
+	this->finish_pipeline();
+
+	CLICKHOUSE_PROBE(query__start, query_text.c_str(), query_text.size(), resultmode);
+
+	ClickHouseSlowLog slow_log(this->stats.get(), "query", query_text);
+
+	if ((resultmode & ClickHouseResult::USE_RESULT) != 0)
+	{
+		if ((resultmode & ClickHouseResult::SEEKABLE_RESULT) != 0)
+		{
+			zend_error(E_WARNING, "CLICKHOUSE_USE_RESULT can't be combined with CLICKHOUSE_SEEKABLE_RESULT");
+			slow_log.set_failed();
+			success = false;
+			return nullptr;
+		}
+
+		// Entry covers the call only, until the server starts to send data, rows are read later by the result
+		zend_object *result = this->query_unbuffered(query_text, resultmode, settings, std::move(tables), success);
+		if (!success)
+			slow_log.set_failed();
+
+		return result;
+	}
+
+	if ((resultmode & ClickHouseResult::COMPRESSED_RESULT) != 0 && (resultmode & ClickHouseResult::SEEKABLE_RESULT) != 0)
+	{
+		zend_error(E_WARNING, "CLICKHOUSE_COMPRESSED_RESULT can't be combined with CLICKHOUSE_SEEKABLE_RESULT");
+		slow_log.set_failed();
+		success = false;
+		return nullptr;
+	}
+
+	// Unbuffered results are never cached, their blocks are not kept, neither are results depending on external data
+	string cache_key;
+	if (cache_ttl > 0 && tables.empty() && ClickHouseCache::is_enabled())
+	{
+		cache_key = ClickHouseCache::make_key(this->options, settings, query_text);
+
+		zend_object *result = this->query_cached(cache_key, resultmode);
+		if (result != nullptr)
+		{
+			CLICKHOUSE_PROBE(query__done, 0, 0, 0);
+
+			success = true;
+			return result;
+		}
+	}
+
 	deque<Block> blocks;
+	deque<ClickHouseResult::BlockStrings> strings;
 	zend_long rows_count = 0;
+	uint64_t bytes_received = 0;
 	bool has_data = false;
 
+	bool direct_strings = (resultmode & ClickHouseResult::DIRECT_STRINGS) != 0;
+
+	// Seekable result needs all blocks at hand, only results read once are spilled
+	size_t spill_threshold = ((resultmode & ClickHouseResult::SEEKABLE_RESULT) == 0 && CLICKHOUSE_G(spill_threshold) > 0) ? static_cast<size_t>(CLICKHOUSE_G(spill_threshold)) : 0;
+	size_t resident_size = 0;
+
+	// Compressed result keeps all blocks in the store, uncompressed one only those after the spill threshold
+	std::unique_ptr<ClickHouseBlockStore> store;
+	if ((resultmode & ClickHouseResult::COMPRESSED_RESULT) != 0)
+		store = std::make_unique<ClickHouseBlockStore>(true);
+
+	// Blocks are written for the cache as they come, decoding of direct strings clears String columns after that
+	Buffer cache_data;
+	BufferOutput cache_output(&cache_data);
+	size_t cache_blocks = 0;
+	bool caching = (!cache_key.empty() && !store);
+
+	clickhouse_stats_add(this->stats.get(), &ClickHouseStats::queries, 1);
+
 	try
 	{
-		Query ch_query(query);
-		ch_query.OnData([&blocks, &rows_count, &has_data] (const Block &block)
+		ClickHouseServerTimer timer(this->stats.get());
+
+		auto on_data = [&blocks, &strings, &rows_count, &has_data, direct_strings, &spill_threshold, &resident_size, &store, &slow_log, &caching, &cache_output, &cache_blocks] (const Block &block)
 		{
 			if (block.GetColumnCount() != 0)
 				has_data = true;
@@ -90,189 +205,1093 @@ auto ClickHouseDB::query(const string &query, bool &success) const -> zend_objec
 			if (block.GetRowCount() == 0)
 				return;
 
+			CLICKHOUSE_PROBE(block__received, block.GetRowCount(), block.GetColumnCount());
+
+			slow_log.start_transfer();
+
 			rows_count += static_cast<zend_long>(block.GetRowCount());
+
+			// Threshold is checked against the estimated size, blocks are not serialized unless they are spilled
+			if (spill_threshold != 0 && !store)
+			{
+				resident_size += ClickHouseCodec::estimate_size(block);
+				if (resident_size > spill_threshold)
+				{
+					store = std::make_unique<ClickHouseBlockStore>(false);
+					if (!store->open_file())
+					{
+						store.reset();
+						spill_threshold = 0;
+					}
+				}
+			}
+
+			// Strings of stored blocks are decoded when the block is read back
+			if (store)
+			{
+				caching = false;
+
+				store->push(block);
+
+				if (spill_threshold != 0 && !store->is_spilled() && store->get_memory_size() > spill_threshold && !store->open_file())
+					spill_threshold = 0;
+
+				return;
+			}
+
+			if (caching)
+			{
+				ClickHouseCodec::write_block(cache_output, block);
+				cache_blocks++;
+			}
+
 			blocks.push_back(block);
-		});
 
-		this->client->Execute(ch_query);
+			if (direct_strings)
+				strings.push_back(ClickHouseResult::decode_strings(block));
+		};
+
+		if (tables.empty())
+		{
+			Query ch_query(query_text);
+			apply_settings(ch_query, settings);
+			ch_query.OnData(on_data);
+			ch_query.OnProfile([this, &bytes_received] (const Profile &profile)
+			{
+				bytes_received += profile.bytes;
+				clickhouse_stats_add(this->stats.get(), &ClickHouseStats::bytes_received, profile.bytes);
+			});
+
+			this->client->Execute(ch_query);
+		}
+		else
+			this->client->SelectWithExternalData(query_text, tables, on_data);
 	}
 	catch (ServerException &e)
 	{
+		CLICKHOUSE_PROBE(query__done, rows_count, bytes_received, 1);
+
+		slow_log.set_result(static_cast<uint64_t>(rows_count), bytes_received);
+		slow_log.set_failed();
+
 		success = false;
 
+		clickhouse_stats_add(this->stats.get(), &ClickHouseStats::errors, 1);
+
 		this->set_error(e.GetCode(), e.what());
 		this->set_affected_rows(-1);
 
-		this->client->ResetConnection();
+		this->reset_connection();
 		return nullptr;
 	}
 	catch (std::runtime_error &e)
 	{
+		CLICKHOUSE_PROBE(query__done, rows_count, bytes_received, 1);
+
+		slow_log.set_result(static_cast<uint64_t>(rows_count), bytes_received);
+		slow_log.set_failed();
+
 		success = false;
 
+		clickhouse_stats_add(this->stats.get(), &ClickHouseStats::errors, 1);
+
 		this->set_error(0, e.what());
 		this->set_affected_rows(-1);
 
-		this->client->ResetConnection();
+		this->reset_connection();
 		return nullptr;
 	}
 
+	CLICKHOUSE_PROBE(query__done, rows_count, bytes_received, 0);
+
+	slow_log.set_result(static_cast<uint64_t>(rows_count), bytes_received);
+
 	success = true;
 
+	clickhouse_stats_add(this->stats.get(), &ClickHouseStats::rows_received, static_cast<uint64_t>(rows_count));
+	clickhouse_stats_add(this->stats.get(), &ClickHouseStats::blocks_received, blocks.size() + (store ? store->get_count() : 0));
+
+	if (store)
+		clickhouse_stats_add(this->stats.get(), &ClickHouseStats::bytes_spilled, store->get_size());
+
 	if (!has_data)
 		return nullptr;
 
+	// Blocks of spilled and compressed results are not at hand
+	if (caching)
+	{
+		cache_output.Flush();
+
+		Buffer buffer;
+		ClickHouseCodec::write_blocks(buffer, cache_data, cache_blocks, static_cast<size_t>(rows_count));
+
+		ClickHouseCache::put(cache_key, buffer, static_cast<uint64_t>(cache_ttl) * 1000000000);
+	}
+
 	this->set_affected_rows(rows_count);
 
-	return clickhouse_result_new(std::move(blocks), rows_count, this->timezone_offset);
+	return clickhouse_result_new(std::move(blocks), std::move(strings), rows_count, this->timezone_offset, resultmode, this->stats, nullptr, std::move(store));
 }
 
-auto ClickHouseDB::insert(const string &table_name, zend_array *values, zend_array *fields) const -> bool
+auto ClickHouseDB::query_cached(const string &key, zend_long resultmode) const -> zend_object*
 {
-	try
+	Buffer buffer;
+	if (!ClickHouseCache::get(key, buffer))
 	{
-		return this->do_insert(table_name, values, fields);
+		clickhouse_stats_add(this->stats.get(), &ClickHouseStats::cache_misses, 1);
+		return nullptr;
 	}
-	catch (ServerException &e)
+
+	ClickHouseTimer timer(this->stats.get(), &ClickHouseStats::conversion_time);
+
+	deque<Block> blocks;
+	size_t rows_count = 0;
+
+	// Broken entry is treated as a miss, the query is sent to the server and the entry is replaced
+	if (!ClickHouseCodec::read_blocks(buffer.data(), buffer.size(), blocks, rows_count))
 	{
-		this->set_error(e.GetCode(), e.what());
-		this->set_affected_rows(-1);
+		clickhouse_stats_add(this->stats.get(), &ClickHouseStats::cache_misses, 1);
+		return nullptr;
+	}
 
-		this->client->ResetConnection();
-		return false;
+	clickhouse_stats_add(this->stats.get(), &ClickHouseStats::cache_hits, 1);
+
+	deque<ClickHouseResult::BlockStrings> strings;
+	if ((resultmode & ClickHouseResult::DIRECT_STRINGS) != 0)
+	{
+		for (const Block &block : blocks)
+			strings.push_back(ClickHouseResult::decode_strings(block));
 	}
-	catch (std::exception &e)
+
+	this->set_affected_rows(static_cast<zend_long>(rows_count));
+
+	return clickhouse_result_new(std::move(blocks), std::move(strings), rows_count, this->timezone_offset, resultmode, this->stats);
+}
+
+auto ClickHouseDB::query_unbuffered(const string &query, zend_long resultmode, const ServerSettings &query_settings, ExternalTables tables, bool &success) const -> zend_object*
+{
+	clickhouse_stats_add(this->stats.get(), &ClickHouseStats::queries, 1);
+
+	auto query_pipeline = make_shared<ClickHousePipeline>(this->client, query, query_settings, std::move(tables));
+
+	bool has_data;
+	if (!query_pipeline->wait_header(has_data))
 	{
-		this->set_error(0, e.what());
+		int32_t code = 0;
+		string message;
+		if (!query_pipeline->get_error(code, message))
+			message = "Query failed";
+
+		// Failed pipeline is finished right after the header, its reconnect is already done
+		query_pipeline->cancel();
+		query_pipeline->add_thread_stats(this->stats.get());
+
+		success = false;
+
+		clickhouse_stats_add(this->stats.get(), &ClickHouseStats::errors, 1);
+
+		this->set_error(code, message.c_str());
 		this->set_affected_rows(-1);
+		return nullptr;
+	}
+
+	success = true;
+
+	// Query without result is already finished, there is nothing to read in background
+	if (!has_data)
+		return nullptr;
+
+	this->pipeline = query_pipeline;
+
+	return clickhouse_result_new({}, {}, 0, this->timezone_offset, resultmode, this->stats, std::move(query_pipeline));
+}
+
+void ClickHouseDB::finish_pipeline() const
+{
+	if (this->pending)
+	{
+		zend_error(E_WARNING, "Query started by start_query() was not finished, it is canceled");
+
+		// Cancel doesn't wait for the server, a blocked read is interrupted and the pipeline thread reconnects
+
+		this->pending->pipeline->cancel();
+		this->pending->pipeline->add_thread_stats(this->stats.get());
+		this->pending.reset();
+	}
+
+	auto active = this->pipeline.lock();
+	if (!active)
+		return;
 
+	this->pipeline.reset();
+
+	if (active->is_finished())
+		return;
+
+	zend_error(E_WARNING, "Unbuffered result was not read completely, the rest of it is discarded");
+	active->cancel();
+	active->add_thread_stats(this->stats.get());
+}
+
+void ClickHouseDB::reset_connection() const
+{
+	clickhouse_stats_add(this->stats.get(), &ClickHouseStats::connects, 1);
+
+	ClickHouseTimer timer(this->stats.get(), &ClickHouseStats::connect_time);
+
+	// Failed reconnect leaves the client without a socket, the next call fails and tries again
+	try
+	{
 		this->client->ResetConnection();
-		return false;
+	}
+	catch (std::exception&)
+	{
+		clickhouse_stats_add(this->stats.get(), &ClickHouseStats::errors, 1);
 	}
 }
 
-auto ClickHouseDB::do_insert(const string &table_name, zend_array *values, zend_array *fields) const -> bool
+auto ClickHouseDB::start_query(const string &query, zend_long resultmode, zend_array *query_settings) const -> bool
 {
 	this->set_error(0, "");
+	this->set_affected_rows(0);
 
 	if (!this->is_connected())
 		return false;
 
-	if (table_name.empty())
+	if (this->pending)
 	{
-		zend_error(E_WARNING, "Table name is empty");
+		zend_error(E_WARNING, "Previous query started by start_query() is not finished, get its result first");
 		return false;
 	}
 
-	if (zend_hash_num_elements(values) == 0)
+	if ((resultmode & (ClickHouseResult::USE_RESULT | ClickHouseResult::COMPRESSED_RESULT)) != 0)
 	{
-		zend_error(E_WARNING, "Values can't be empty");
+		zend_error(E_WARNING, "CLICKHOUSE_USE_RESULT and CLICKHOUSE_COMPRESSED_RESULT are not supported by start_query()");
 		return false;
 	}
 
-	vector<zend_string*> fields_data;
+	ServerSettings settings = this->settings;
+	if (query_settings != nullptr && !ClickHouseDB::parse_settings(query_settings, settings))
+		return false;
 
-	if (!ClickHouseDB::parse_fields(fields, fields_data))
+	if (this->get_notify_fd() == -1)
 		return false;
 
-	zval *first_row = zend_hash_index_find(values, 0);
-	if (first_row == nullptr)
+	this->finish_pipeline();
+
+	CLICKHOUSE_PROBE(query__start, query.c_str(), query.size(), resultmode);
+
+	clickhouse_stats_add(this->stats.get(), &ClickHouseStats::queries, 1);
+
+	this->pending = std::make_unique<PendingQuery>();
+	this->pending->pipeline = make_shared<ClickHousePipeline>(this->client, query, settings, ExternalTables(), this->notify_fd);
+	this->pending->resultmode = resultmode | this->type_mapping;
+	this->pending->rows_count = 0;
+
+	return true;
+}
+
+auto ClickHouseDB::get_notify_fd() const -> int
+{
+	if (this->notify_fd != -1)
+		return this->notify_fd;
+
+	this->notify_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	if (this->notify_fd == -1)
+		zend_error(E_WARNING, "Failed to create event descriptor: %s", strerror(errno));
+
+	return this->notify_fd;
+}
+
+auto ClickHouseDB::process_io() const -> bool
+{
+	if (!this->pending)
+	{
+		zend_error(E_WARNING, "No query was started by start_query()");
+		return true;
+	}
+
+	// Counter is reset before taking blocks, so a block pushed after that makes the descriptor readable again
+	eventfd_t events;
+	eventfd_read(this->notify_fd, &events);
+
+	// Nothing is pushed after the pipeline is finished, all blocks are taken below then
+	bool finished = this->pending->pipeline->is_finished();
+
+	Block block;
+	while (this->pending->pipeline->try_pop(block))
+	{
+		this->pending->rows_count += block.GetRowCount();
+		this->pending->blocks.push_back(std::move(block));
+	}
+
+	return finished;
+}
+
+auto ClickHouseDB::get_result(bool &success) const -> zend_object*
+{
+	this->set_error(0, "");
+	this->set_affected_rows(0);
+
+	success = false;
+
+	if (!this->process_io())
+	{
+		zend_error(E_WARNING, "Query is not finished yet, call process_io() until it returns true");
+		return nullptr;
+	}
+
+	if (!this->pending)
+		return nullptr;
+
+	std::unique_ptr<PendingQuery> finished = std::move(this->pending);
+
+	uint64_t bytes_received = finished->pipeline->get_bytes_received();
+	clickhouse_stats_add(this->stats.get(), &ClickHouseStats::bytes_received, bytes_received);
+	finished->pipeline->add_thread_stats(this->stats.get());
+
+	int32_t code = 0;
+	string message;
+	bool failed = finished->pipeline->get_error(code, message);
+
+	CLICKHOUSE_PROBE(query__done, finished->rows_count, bytes_received, failed);
+
+	if (failed)
+	{
+		clickhouse_stats_add(this->stats.get(), &ClickHouseStats::errors, 1);
+
+		this->set_error(code, message.c_str());
+		this->set_affected_rows(-1);
+		return nullptr;
+	}
+
+	success = true;
+
+	clickhouse_stats_add(this->stats.get(), &ClickHouseStats::rows_received, finished->rows_count);
+	clickhouse_stats_add(this->stats.get(), &ClickHouseStats::blocks_received, finished->blocks.size());
+
+	// Header is already there for a finished pipeline, nothing is waited for
+	bool has_data;
+	(void)finished->pipeline->wait_header(has_data);
+	if (!has_data)
+		return nullptr;
+
+	deque<ClickHouseResult::BlockStrings> strings;
+	if ((finished->resultmode & ClickHouseResult::DIRECT_STRINGS) != 0)
+	{
+		for (const Block &block : finished->blocks)
+			strings.push_back(ClickHouseResult::decode_strings(block));
+	}
+
+	this->set_affected_rows(static_cast<zend_long>(finished->rows_count));
+
+	return clickhouse_result_new(std::move(finished->blocks), std::move(strings), finished->rows_count, this->timezone_offset, finished->resultmode, this->stats);
+}
+
+auto ClickHouseDB::query_parallel(const string &query, zend_array *endpoints, zend_long merge, const zend_string *key, zend_long resultmode, zend_array *query_settings, bool &success) const -> zend_object*
+{
+	this->set_error(0, "");
+	this->set_affected_rows(0);
+
+	if (!this->is_connected())
+		return nullptr;
+
+	if ((resultmode & (ClickHouseResult::USE_RESULT | ClickHouseResult::COMPRESSED_RESULT)) != 0)
+	{
+		zend_error(E_WARNING, "CLICKHOUSE_USE_RESULT and CLICKHOUSE_COMPRESSED_RESULT are not supported by query_parallel()");
+		return nullptr;
+	}
+
+	if (merge != static_cast<zend_long>(ClickHouseParallelQuery::Merge::CONCAT) && merge != static_cast<zend_long>(ClickHouseParallelQuery::Merge::SORTED))
+	{
+		zend_error(E_WARNING, "Invalid merge mode %ld", merge);
+		return nullptr;
+	}
+
+	if (merge == static_cast<zend_long>(ClickHouseParallelQuery::Merge::SORTED) && key == nullptr)
+	{
+		zend_error(E_WARNING, "Key column is required for CLICKHOUSE_MERGE_SORTED");
+		return nullptr;
+	}
+
+	resultmode |= this->type_mapping;
+
+	ServerSettings settings = this->settings;
+	if (query_settings != nullptr && !ClickHouseDB::parse_settings(query_settings, settings))
+		return nullptr;
+
+	vector<ClickHouseParallelQuery::Shard> shards;
+	if (!this->parse_endpoints(endpoints, shards))
+		return nullptr;
+
+	if (shards.empty())
+	{
+		zend_error(E_WARNING, "No endpoints are given");
+		return nullptr;
+	}
+
+	auto endpoint_key = [] (const ClientOptions &options) -> string
+	{
+		return options.host + ":" + std::to_string(options.port);
+	};
+
+	// Connection is taken out of the map while its thread uses it, an endpoint listed twice gets a new one
+	for (ClickHouseParallelQuery::Shard &shard : shards)
+	{
+		auto found = this->shard_clients.find(endpoint_key(shard.options));
+		if (found == this->shard_clients.end())
+			continue;
+
+		shard.client = std::move(found->second);
+		this->shard_clients.erase(found);
+	}
+
+	CLICKHOUSE_PROBE(query__start, query.c_str(), query.size(), resultmode);
+
+	ClickHouseSlowLog slow_log(this->stats.get(), "query_parallel", query);
+
+	clickhouse_stats_add(this->stats.get(), &ClickHouseStats::queries, shards.size());
+
+	{
+		ClickHouseTimer timer(this->stats.get(), &ClickHouseStats::server_time);
+
+		ClickHouseParallelQuery::execute(shards, query, settings);
+	}
+
+	size_t rows_count = 0;
+	size_t blocks_count = 0;
+	uint64_t bytes_received = 0;
+	bool has_data = false;
+	const ClickHouseParallelQuery::Shard *failed = nullptr;
+
+	for (ClickHouseParallelQuery::Shard &shard : shards)
+	{
+		rows_count += shard.rows_count;
+		blocks_count += shard.blocks.size();
+		bytes_received += shard.bytes_received;
+
+		// Servers are waited for at once, decompression on their threads overlaps the wait and stays in the server time
+		clickhouse_stats_add_decompression(this->stats.get(), shard.decompression);
+
+		if (shard.header.GetColumnCount() != 0)
+			has_data = true;
+
+		if (shard.connected)
+		{
+			clickhouse_stats_add(this->stats.get(), &ClickHouseStats::connects, 1);
+			clickhouse_stats_add(this->stats.get(), &ClickHouseStats::connect_time, shard.connect_time);
+		}
+
+		if (!shard.error_message.empty())
+		{
+			clickhouse_stats_add(this->stats.get(), &ClickHouseStats::errors, 1);
+
+			if (failed == nullptr)
+				failed = &shard;
+		}
+
+		if (shard.client)
+			this->shard_clients[endpoint_key(shard.options)] = shard.client;
+	}
+
+	clickhouse_stats_add(this->stats.get(), &ClickHouseStats::bytes_received, bytes_received);
+
+	slow_log.set_result(rows_count, bytes_received);
+
+	// Result of a part of servers would look complete, so any failure fails the whole query
+	if (failed != nullptr)
+	{
+		CLICKHOUSE_PROBE(query__done, rows_count, bytes_received, 1);
+
+		slow_log.set_failed();
+
+		success = false;
+
+		string message = endpoint_key(failed->options) + ": " + failed->error_message;
+
+		this->set_error(failed->error_code, message.c_str());
+		this->set_affected_rows(-1);
+		return nullptr;
+	}
+
+	CLICKHOUSE_PROBE(query__done, rows_count, bytes_received, 0);
+
+	clickhouse_stats_add(this->stats.get(), &ClickHouseStats::rows_received, rows_count);
+	clickhouse_stats_add(this->stats.get(), &ClickHouseStats::blocks_received, blocks_count);
+
+	deque<Block> blocks;
+	string message;
+
+	bool merged = ClickHouseParallelQuery::check_headers(shards, message);
+	if (merged)
+	{
+		if (merge == static_cast<zend_long>(ClickHouseParallelQuery::Merge::SORTED))
+			merged = ClickHouseParallelQuery::merge_sorted(shards, string(ZSTR_VAL(key), ZSTR_LEN(key)), blocks, message);
+		else
+			ClickHouseParallelQuery::concat(shards, blocks);
+	}
+
+	if (!merged)
+	{
+		zend_error(E_WARNING, "%s", message.c_str());
+
+		slow_log.set_failed();
+
+		success = false;
+
+		this->set_affected_rows(-1);
+		return nullptr;
+	}
+
+	success = true;
+
+	if (!has_data)
+		return nullptr;
+
+	deque<ClickHouseResult::BlockStrings> strings;
+	if ((resultmode & ClickHouseResult::DIRECT_STRINGS) != 0)
+	{
+		for (const Block &block : blocks)
+			strings.push_back(ClickHouseResult::decode_strings(block));
+	}
+
+	this->set_affected_rows(static_cast<zend_long>(rows_count));
+
+	return clickhouse_result_new(std::move(blocks), std::move(strings), rows_count, this->timezone_offset, resultmode, this->stats);
+}
+
+auto ClickHouseDB::parse_endpoints(zend_array *endpoints, vector<ClickHouseParallelQuery::Shard> &shards) const -> bool
+{
+	zval *value;
+	ZEND_HASH_FOREACH_VAL(endpoints, value)
+	{
+		if (Z_TYPE_P(value) != IS_STRING)
+		{
+			zend_error(E_WARNING, "Endpoint must be a string 'host' or 'host:port'");
+			return false;
+		}
+
+		string_view endpoint(Z_STRVAL_P(value), Z_STRLEN_P(value));
+
+		// IPv6 address is written in brackets to be followed by a port
+		string_view host = endpoint;
+		string_view port;
+		bool has_port = false;
+
+		if (!endpoint.empty() && endpoint.front() == '[')
+		{
+			size_t close = endpoint.find(']');
+			if (close == string_view::npos || (close + 1 < endpoint.size() && endpoint[close + 1] != ':'))
+			{
+				zend_error(E_WARNING, "Invalid endpoint '%s'", Z_STRVAL_P(value));
+				return false;
+			}
+
+			host = endpoint.substr(1, close - 1);
+
+			has_port = (close + 1 < endpoint.size());
+			if (has_port)
+				port = endpoint.substr(close + 2);
+		}
+		else
+		{
+			size_t colon = endpoint.find(':');
+
+			has_port = (colon != string_view::npos);
+			if (has_port)
+			{
+				host = endpoint.substr(0, colon);
+				port = endpoint.substr(colon + 1);
+			}
+		}
+
+		if (host.empty())
+		{
+			zend_error(E_WARNING, "Invalid endpoint '%s'", Z_STRVAL_P(value));
+			return false;
+		}
+
+		// Other options are the same as of the connection, the port too if it is not given
+		ClickHouseParallelQuery::Shard shard;
+		shard.options = this->options;
+		shard.options.SetHost(string(host));
+
+		if (has_port)
+		{
+			unsigned int number = 0;
+
+			auto [end, error] = std::from_chars(port.data(), port.data() + port.size(), number);
+			if (error != std::errc() || end != port.data() + port.size() || number == 0 || number > 65535)
+			{
+				zend_error(E_WARNING, "Invalid port in endpoint '%s'", Z_STRVAL_P(value));
+				return false;
+			}
+
+			shard.options.SetPort(number);
+		}
+
+		shards.push_back(std::move(shard));
+	}
+	ZEND_HASH_FOREACH_END();
+
+	return true;
+}
+
+auto ClickHouseDB::query_to_stream(const string &query, php_stream *stream, ClickHouseExport::Format format) const -> bool
+{
+	this->set_error(0, "");
+	this->set_affected_rows(0);
+
+	if (!this->is_connected())
+		return false;
+
+	this->finish_pipeline();
+
+	ClickHouseSlowLog slow_log(this->stats.get(), "query_to_stream", query);
+
+	CLICKHOUSE_PROBE(query__start, query.c_str(), query.size(), 0);
+
+	ClickHouseExport writer(stream, format, this->timezone_offset);
+	bool write_failed = false;
+
+	clickhouse_stats_add(this->stats.get(), &ClickHouseStats::queries, 1);
+
+	// Blocks are written inside clickhouse-cpp callback, writing and decompression time is excluded from the server time
+	uint64_t start = ClickHouseStats::now();
+	DecompressStats start_decompression = lz4_get_thread_stats();
+	uint64_t conversion_time = 0;
+	size_t blocks_count = 0;
+	uint64_t bytes_received = 0;
+
+	try
+	{
+		Query ch_query(query);
+		apply_settings(ch_query, this->settings);
+		ch_query.OnDataCancelable([&writer, &write_failed, &conversion_time, &blocks_count, &slow_log] (const Block &block) -> bool
+		{
+			if (block.GetRowCount() == 0)
+				return true;
+
+			slow_log.start_transfer();
+
+			uint64_t block_start = ClickHouseStats::now();
+
+			// Returning false cancels the query, no need to receive the rest of the data
+			write_failed = !writer.write(block);
+
+			conversion_time += ClickHouseStats::now() - block_start;
+			blocks_count++;
+
+			return !write_failed;
+		});
+		ch_query.OnProfile([this, &bytes_received] (const Profile &profile)
+		{
+			bytes_received += profile.bytes;
+			clickhouse_stats_add(this->stats.get(), &ClickHouseStats::bytes_received, profile.bytes);
+		});
+
+		this->client->Execute(ch_query);
+	}
+	catch (ServerException &e)
+	{
+		clickhouse_stats_add(this->stats.get(), &ClickHouseStats::errors, 1);
+
+		this->set_error(e.GetCode(), e.what());
+		this->set_affected_rows(-1);
+
+		slow_log.set_result(writer.get_rows_count(), bytes_received);
+		slow_log.set_failed();
+
+		CLICKHOUSE_PROBE(query__done, writer.get_rows_count(), bytes_received, 1);
+
+		this->reset_connection();
+		return false;
+	}
+	catch (std::runtime_error &e)
+	{
+		clickhouse_stats_add(this->stats.get(), &ClickHouseStats::errors, 1);
+
+		this->set_error(0, e.what());
+		this->set_affected_rows(-1);
+
+		slow_log.set_result(writer.get_rows_count(), bytes_received);
+		slow_log.set_failed();
+
+		CLICKHOUSE_PROBE(query__done, writer.get_rows_count(), bytes_received, 1);
+
+		this->reset_connection();
+		return false;
+	}
+
+	DecompressStats decompression = lz4_get_stats_since(start_decompression);
+	clickhouse_stats_add_decompression(this->stats.get(), decompression);
+
+	clickhouse_stats_add(this->stats.get(), &ClickHouseStats::server_time, ClickHouseStats::now() - start - conversion_time - decompression.time);
+	clickhouse_stats_add(this->stats.get(), &ClickHouseStats::conversion_time, conversion_time);
+	clickhouse_stats_add(this->stats.get(), &ClickHouseStats::rows_received, writer.get_rows_count());
+	clickhouse_stats_add(this->stats.get(), &ClickHouseStats::blocks_received, blocks_count);
+
+	slow_log.set_result(writer.get_rows_count(), bytes_received);
+
+	if (write_failed)
+	{
+		this->set_error(0, "Failed to write query result to stream");
+		this->set_affected_rows(-1);
+		slow_log.set_failed();
+
+		CLICKHOUSE_PROBE(query__done, writer.get_rows_count(), bytes_received, 1);
+		return false;
+	}
+
+	CLICKHOUSE_PROBE(query__done, writer.get_rows_count(), bytes_received, 0);
+
+	this->set_affected_rows(static_cast<zend_long>(writer.get_rows_count()));
+	return true;
+}
+
+auto ClickHouseDB::insert(const string &table_name, zend_array *values, zend_array *fields, zend_array *insert_settings, bool async) const -> bool
+{
+	clickhouse_stats_add(this->stats.get(), &ClickHouseStats::inserts, 1);
+
+	ServerSettings settings = this->settings;
+	if (insert_settings != nullptr && !ClickHouseDB::parse_settings(insert_settings, settings))
+		return false;
+
+	ClickHouseSlowLog slow_log(this->stats.get(), async ? "insert_async" : "insert", table_name);
+
+	try
+	{
+		return this->do_insert(table_name, values, fields, settings, async, slow_log);
+	}
+	catch (ServerException &e)
+	{
+		slow_log.set_failed();
+
+		clickhouse_stats_add(this->stats.get(), &ClickHouseStats::errors, 1);
+
+		this->set_error(e.GetCode(), e.what());
+		this->set_affected_rows(-1);
+
+		this->reset_connection();
+		return false;
+	}
+	catch (std::exception &e)
+	{
+		slow_log.set_failed();
+
+		clickhouse_stats_add(this->stats.get(), &ClickHouseStats::errors, 1);
+
+		this->set_error(0, e.what());
+		this->set_affected_rows(-1);
+
+		this->reset_connection();
+		return false;
+	}
+}
+
+auto ClickHouseDB::do_insert(const string &table_name, zend_array *values, zend_array *fields, const ServerSettings &insert_settings, bool async, ClickHouseSlowLog &slow_log) const -> bool
+{
+	this->set_error(0, "");
+
+	if (!this->is_connected())
+		return false;
+
+	this->finish_pipeline();
+
+	if (table_name.empty())
+	{
+		zend_error(E_WARNING, "Table name is empty");
+		return false;
+	}
+
+	if (zend_hash_num_elements(values) == 0)
+	{
+		zend_error(E_WARNING, "Values can't be empty");
+		return false;
+	}
+
+	vector<zend_string*> fields_data;
+
+	if (!ClickHouseDB::parse_fields(fields, fields_data))
+		return false;
+
+	zval *first_row = zend_hash_index_find(values, 0);
+	if (first_row == nullptr)
+	{
+		zend_error(E_WARNING, "Values must be simple array with rows starting from index 0");
+		return false;
+	}
+
+	zval column_names;
+	array_init(&column_names);
+
+	bool value_found = false;
+	bool numeric_keys = false;
+
+	string columns;
+
+	Bucket *first_row_column_bucket;
+	ZEND_HASH_FOREACH_BUCKET(Z_ARR_P(first_row), first_row_column_bucket)
+	{
+		zend_string *name;
+
+		bool is_numeric_key = (first_row_column_bucket->key == nullptr);
+		if (value_found && is_numeric_key != numeric_keys)
+		{
+			zend_error(E_WARNING, "Mixing numeric and string field names is not allowed");
+			zend_array_destroy(Z_ARR(column_names));
+			return false;
+		}
+
+		if (is_numeric_key)
+		{
+			if (first_row_column_bucket->h >= fields_data.size())
+			{
+				zend_error(E_WARNING, "Field name is not provided for column %lu at row 0", first_row_column_bucket->h);
+				zend_array_destroy(Z_ARR(column_names));
+				return false;
+			}
+
+			name = fields_data[first_row_column_bucket->h];
+		}
+		else
+		{
+			name = first_row_column_bucket->key;
+
+			if (!ClickHouseDB::set_column_index(Z_ARR(column_names), name))
+			{
+				zend_error(E_WARNING, "Mixing numeric and string field names is not allowed");
+				zend_array_destroy(Z_ARR(column_names));
+				return false;
+			}
+		}
+
+		if (value_found)
+			columns.append(", ");
+
+		columns.append(ZSTR_VAL(name), ZSTR_LEN(name));
+
+		value_found = true;
+		numeric_keys = is_numeric_key;
+	}
+	ZEND_HASH_FOREACH_END();
+
+	string insert_query("INSERT INTO ");
+	insert_query.append(table_name);
+	insert_query.append(" (");
+	insert_query.append(columns);
+	insert_query.append(")");
+
+	// InsertQuery() takes only the text, so settings go to SETTINGS clause
+	append_settings(insert_query, insert_settings);
+
+	insert_query.append(" VALUES");
+
+	// ReSharper disable once CppTooWideScopeInitStatement
+	size_t columns_count = zend_hash_num_elements(Z_ARR_P(first_row));
+
+	if ((!fields_data.empty() && fields_data.size() != columns_count) || (fields_data.empty() && zend_hash_num_elements(Z_ARR(column_names)) != columns_count))
+	{
+		zend_error(E_WARNING, "Fields count must be equal to columns count");
+		return false;
+	}
+
+	Block description_block;
+
+	ClickHouseAsyncWriter *writer = nullptr;
+
+	if (async)
+	{
+		ClickHouseAsyncWriter::Config config{
+			static_cast<size_t>(std::max<zend_long>(CLICKHOUSE_G(async_flush_rows), 1)),
+			std::chrono::milliseconds(std::max<zend_long>(CLICKHOUSE_G(async_flush_interval_ms), 1)),
+			static_cast<size_t>(std::max<zend_long>(CLICKHOUSE_G(async_max_rows), 1))
+		};
+
+		writer = ClickHouseAsyncWriter::get(this->options, config);
+
+		if (!writer->get_description(insert_query, description_block))
+		{
+			if (!this->describe_columns(table_name, columns, description_block))
+			{
+				zend_array_destroy(Z_ARR(column_names));
+				return false;
+			}
+
+			writer->set_description(insert_query, description_block);
+		}
+	}
+	else
+	{
+		ClickHouseServerTimer timer(this->stats.get());
+
+		this->client->InsertQuery(insert_query, [&description_block] (const Block &block)
+		{
+			description_block = block;
+		});
+	}
+
+	slow_log.start_transfer();
+
+	uint64_t conversion_start = ClickHouseStats::now();
+
+	Block block;
+	zend_long rows = 0;
+
+	bool converted = ClickHouseDB::convert_rows(values, fields_data, Z_ARR(column_names), numeric_keys, description_block, block, rows);
+
+	zend_array_destroy(Z_ARR(column_names));
+
+	if (!converted)
+		return false;
+
+	block.RefreshRowCount();
+
+	clickhouse_stats_add(this->stats.get(), &ClickHouseStats::conversion_time, ClickHouseStats::now() - conversion_start);
+
+	slow_log.set_result(static_cast<uint64_t>(rows), 0);
+
+	if (writer != nullptr)
+	{
+		// Block is not sent by this call, its size is counted only for an entry which is going to be written
+		if (slow_log.is_slow())
+			slow_log.set_result(static_cast<uint64_t>(rows), ClickHouseCodec::estimate_size(block));
+
+		if (!writer->push(insert_query, block))
+		{
+			zend_error(E_WARNING, "Async insert buffer is full, %ld rows are dropped", rows);
+			this->set_affected_rows(-1);
+			return false;
+		}
+
+		this->set_affected_rows(rows);
+		return true;
+	}
+
+	ClickHouseServerTimer server_timer(this->stats.get());
+
+	CLICKHOUSE_PROBE(insert__start, insert_query.c_str(), rows);
+
+	try
+	{
+		this->client->InsertData(block);
+	}
+	catch (...)
+	{
+		// Errors are handled by the caller, only the probe pair is closed here
+		CLICKHOUSE_PROBE(insert__done, rows, 1);
+		throw;
+	}
+
+	CLICKHOUSE_PROBE(insert__done, rows, 0);
+
+	clickhouse_stats_add(this->stats.get(), &ClickHouseStats::rows_sent, static_cast<uint64_t>(rows));
+	clickhouse_stats_add(this->stats.get(), &ClickHouseStats::blocks_sent, 1);
+	// Insert is not measured by the server, the same size goes to the log
+	size_t bytes = ClickHouseCodec::estimate_size(block);
+	clickhouse_stats_add(this->stats.get(), &ClickHouseStats::bytes_sent, bytes);
+	slow_log.set_result(static_cast<uint64_t>(rows), bytes);
+
+	this->set_affected_rows(rows);
+	return true;
+}
+
+auto ClickHouseDB::describe_columns(const string &table_name, const string &columns, Block &description) const -> bool
+{
+	// Header of an empty result has the same column types as the INSERT query would send
+	string query("SELECT ");
+	query.append(columns);
+	query.append(" FROM ");
+	query.append(table_name);
+	query.append(" LIMIT 0");
+
+	bool received = false;
+
+	Query ch_query(query);
+	apply_settings(ch_query, this->settings);
+	ch_query.OnData([&description, &received] (const Block &block)
+	{
+		if (received)
+			return;
+
+		description = block;
+		received = true;
+	});
+
+	ClickHouseServerTimer timer(this->stats.get());
+
+	this->client->Execute(ch_query);
+
+	if (!received || description.GetColumnCount() == 0)
 	{
-		zend_error(E_WARNING, "Values must be simple array with rows starting from index 0");
+		zend_error(E_WARNING, "Failed to get columns of table '%s'", table_name.c_str());
 		return false;
 	}
 
-	zval column_names;
-	array_init(&column_names);
+	return true;
+}
 
-	bool value_found = false;
-	bool numeric_keys = false;
+auto ClickHouseDB::convert_rows(zend_array *values, const vector<zend_string*> &fields_data, zend_array *column_names, bool numeric_keys, const Block &description_block, Block &block, zend_long &rows) -> bool
+{
+	vector<zend_array*> enum_codes = ClickHouseDB::build_enum_codes(description_block);
 
-	string insert_query("INSERT INTO ");
-	insert_query.append(table_name);
-	insert_query.append(" (");
+	bool converted = ClickHouseDB::convert_values(values, fields_data, column_names, numeric_keys, description_block, enum_codes, block, rows);
 
-	Bucket *first_row_column_bucket;
-	ZEND_HASH_FOREACH_BUCKET(Z_ARR_P(first_row), first_row_column_bucket)
+	for (zend_array *codes : enum_codes)
 	{
-		zend_string *name;
-
-		bool is_numeric_key = (first_row_column_bucket->key == nullptr);
-		if (value_found && is_numeric_key != numeric_keys)
-		{
-			zend_error(E_WARNING, "Mixing numeric and string field names is not allowed");
-			zend_array_destroy(Z_ARR(column_names));
-			return false;
-		}
-
-		if (is_numeric_key)
-		{
-			if (first_row_column_bucket->h >= fields_data.size())
-			{
-				zend_error(E_WARNING, "Field name is not provided for column %lu at row 0", first_row_column_bucket->h);
-				zend_array_destroy(Z_ARR(column_names));
-				return false;
-			}
+		if (codes != nullptr)
+			zend_array_destroy(codes);
+	}
 
-			name = fields_data[first_row_column_bucket->h];
-		}
-		else
-		{
-			name = first_row_column_bucket->key;
+	return converted;
+}
 
-			if (!ClickHouseDB::set_column_index(Z_ARR(column_names), name))
-			{
-				zend_error(E_WARNING, "Mixing numeric and string field names is not allowed");
-				zend_array_destroy(Z_ARR(column_names));
-				return false;
-			}
-		}
+auto ClickHouseDB::build_enum_codes(const Block &description_block) -> vector<zend_array*>
+{
+	vector<zend_array*> enum_codes(description_block.GetColumnCount(), nullptr);
 
-		if (value_found)
-			insert_query.append(", ");
+	for (size_t i = 0; i < description_block.GetColumnCount(); i++)
+	{
+		ColumnRef column = description_block[i];
+		if (column->Type()->GetCode() == Type::Code::Nullable)
+			column = column->As<ColumnNullable>()->Nested();
 
-		insert_query.append(ZSTR_VAL(name), ZSTR_LEN(name));
+		// ReSharper disable once CppTooWideScope
+		Type::Code code = column->Type()->GetCode();
+		if (code != Type::Code::Enum8 && code != Type::Code::Enum16)
+			continue;
 
-		value_found = true;
-		numeric_keys = is_numeric_key;
-	}
-	ZEND_HASH_FOREACH_END();
+		auto enum_type = column->Type()->As<EnumType>();
 
-	insert_query.append(") VALUES");
+		zend_array *codes = zend_new_array(0);
+		for (auto iter = enum_type->BeginValueToName(); iter != enum_type->EndValueToName(); ++iter)
+		{
+			zval value;
+			ZVAL_LONG(&value, iter->first);
 
-	// ReSharper disable once CppTooWideScopeInitStatement
-	size_t columns_count = zend_hash_num_elements(Z_ARR_P(first_row));
+			zend_hash_str_update(codes, iter->second.data(), iter->second.length(), &value);
+		}
 
-	if ((!fields_data.empty() && fields_data.size() != columns_count) || (fields_data.empty() && zend_hash_num_elements(Z_ARR(column_names)) != columns_count))
-	{
-		zend_error(E_WARNING, "Fields count must be equal to columns count");
-		return false;
+		enum_codes[i] = codes;
 	}
 
-	Block description_block;
-
-	this->client->InsertQuery(insert_query, [&description_block] (const Block &block)
-	{
-		description_block = block;
-	});
-
-	Block block;
-	zend_long rows = 0;
+	return enum_codes;
+}
 
+auto ClickHouseDB::convert_values(zend_array *values, const vector<zend_string*> &fields_data, zend_array *column_names, bool numeric_keys, const Block &description_block, const vector<zend_array*> &enum_codes, Block &block, zend_long &rows) -> bool
+{
 	Bucket *row_bucket;
 	ZEND_HASH_FOREACH_BUCKET(values, row_bucket)
 	{
 		if (row_bucket->key != nullptr)
 		{
 			zend_error(E_WARNING, "Values key must be number but got string '%s'", ZSTR_VAL(row_bucket->key));
-			zend_array_destroy(Z_ARR(column_names));
 			return false;
 		}
 
 		if (Z_TYPE(row_bucket->val) != IS_ARRAY)
 		{
 			zend_error(E_WARNING, "Values must be array but got type %d", Z_TYPE(row_bucket->val));
-			zend_array_destroy(Z_ARR(column_names));
 			return false;
 		}
 
@@ -288,7 +1307,6 @@ auto ClickHouseDB::do_insert(const string &table_name, zend_array *values, zend_
 			if (is_numeric_key != numeric_keys)
 			{
 				zend_error(E_WARNING, "Mixing numeric and string field names is not allowed");
-				zend_array_destroy(Z_ARR(column_names));
 				return false;
 			}
 
@@ -297,7 +1315,6 @@ auto ClickHouseDB::do_insert(const string &table_name, zend_array *values, zend_
 				if (column_bucket->h >= fields_data.size())
 				{
 					zend_error(E_WARNING, "Field name is not provided for column %lu at row %lu", column_bucket->h, row_bucket->h);
-					zend_array_destroy(Z_ARR(column_names));
 					return false;
 				}
 
@@ -309,38 +1326,27 @@ auto ClickHouseDB::do_insert(const string &table_name, zend_array *values, zend_
 			{
 				name = column_bucket->key;
 
-				zval *index_val = zend_hash_find(Z_ARR(column_names), name);
+				zval *index_val = zend_hash_find(column_names, name);
 				if (index_val == nullptr)
 				{
 					zend_error(E_WARNING, "Unexpected column '%s', columns must be the same for each row", ZSTR_VAL(name));
-					zend_array_destroy(Z_ARR(column_names));
 					return false;
 				}
 
 				index = Z_LVAL_P(index_val);
 			}
 
-			if (!ClickHouseDB::add_by_type(block, name, index, &column_bucket->val, description_block[index]))
-			{
-				zend_array_destroy(Z_ARR(column_names));
+			if (!ClickHouseDB::add_by_type(block, name, index, &column_bucket->val, description_block[index], enum_codes[index]))
 				return false;
-			}
 		}
 		ZEND_HASH_FOREACH_END();
 	}
 	ZEND_HASH_FOREACH_END();
 
-	zend_array_destroy(Z_ARR(column_names));
-
-	block.RefreshRowCount();
-
-	this->client->InsertData(block);
-
-	this->set_affected_rows(rows);
 	return true;
 }
 
-auto ClickHouseDB::add_by_type(Block &block, zend_string *name, zend_ulong index, zval *z_value, const ColumnRef &description_column, bool nullable) -> bool
+auto ClickHouseDB::add_by_type(Block &block, zend_string *name, zend_ulong index, zval *z_value, const ColumnRef &description_column, const zend_array *enum_codes, bool nullable) -> bool
 {
 	auto php_type = Z_TYPE_P(z_value);
 	bool types_match;
@@ -377,11 +1383,18 @@ auto ClickHouseDB::add_by_type(Block &block, zend_string *name, zend_ulong index
 			types_match = !nullable;
 			break;
 //		case Type::Code::Tuple:
-//		case Type::Code::Enum8:
-//		case Type::Code::Enum16:
-//		case Type::Code::UUID:
-//		case Type::Code::IPv4:
-//		case Type::Code::IPv6:
+		case Type::Code::Enum8:
+		case Type::Code::Enum16:
+			types_match = (php_type == IS_STRING || php_type == IS_LONG || (nullable && php_type == IS_NULL));
+			break;
+		case Type::Code::UUID:
+		case Type::Code::IPv6:
+			types_match = (php_type == IS_STRING || (nullable && php_type == IS_NULL));
+			break;
+		case Type::Code::IPv4:
+			// Integer is the same as fetched with CLICKHOUSE_IPV4_AS_INT
+			types_match = (php_type == IS_STRING || php_type == IS_LONG || (nullable && php_type == IS_NULL));
+			break;
 //		case Type::Code::Int128:
 //		case Type::Code::Decimal:
 //		case Type::Code::Decimal32:
@@ -492,13 +1505,89 @@ auto ClickHouseDB::add_by_type(Block &block, zend_string *name, zend_ulong index
 		}
 //		case Type::Code::Array:
 		case Type::Code::Nullable:
-			return add_by_type(block, name, index, z_value, description_column->As<ColumnNullable>()->Nested(), true);
+			return add_by_type(block, name, index, z_value, description_column->As<ColumnNullable>()->Nested(), enum_codes, true);
 //		case Type::Code::Tuple:
-//		case Type::Code::Enum8:
-//		case Type::Code::Enum16:
-//		case Type::Code::UUID:
-//		case Type::Code::IPv4:
-//		case Type::Code::IPv6:
+		case Type::Code::Enum8:
+		case Type::Code::Enum16:
+		{
+			auto enum_type = description_column->Type()->As<EnumType>();
+
+			zend_long code = 0;
+			if (php_type == IS_LONG)
+			{
+				code = Z_LVAL_P(z_value);
+
+				if (code < std::numeric_limits<int16_t>::min() || code > std::numeric_limits<int16_t>::max() || !enum_type->HasEnumValue(static_cast<int16_t>(code)))
+				{
+					zend_error(E_WARNING, "Value %ld is not in %s for column '%s'", code, enum_type->GetName().c_str(), ZSTR_VAL(name));
+					return false;
+				}
+			}
+			else if (php_type == IS_STRING)
+			{
+				// Names are looked up by the hash already computed for PHP string
+				zval *found = (enum_codes != nullptr) ? zend_hash_find(enum_codes, Z_STR_P(z_value)) : nullptr;
+				if (found == nullptr)
+				{
+					zend_error(E_WARNING, "Value '%s' is not in %s for column '%s'", Z_STRVAL_P(z_value), enum_type->GetName().c_str(), ZSTR_VAL(name));
+					return false;
+				}
+
+				code = Z_LVAL_P(found);
+			}
+
+			if (type == Type::Code::Enum8)
+				add_enum<ColumnEnum8>(block, name, index, description_column->Type(), static_cast<int16_t>(code), nullable, php_type == IS_NULL);
+			else
+				add_enum<ColumnEnum16>(block, name, index, description_column->Type(), static_cast<int16_t>(code), nullable, php_type == IS_NULL);
+			break;
+		}
+		case Type::Code::UUID:
+		{
+			UUID uuid = {0, 0};
+			if (php_type == IS_STRING && !parse_uuid(string_view(Z_STRVAL_P(z_value), Z_STRLEN_P(z_value)), uuid))
+			{
+				zend_error(E_WARNING, "Invalid UUID value for column '%s'", ZSTR_VAL(name));
+				return false;
+			}
+
+			add_value<ColumnUUID>(block, name, index, uuid, nullable, php_type == IS_NULL);
+			break;
+		}
+		case Type::Code::IPv4:
+		{
+			in_addr address{};
+			if (php_type == IS_LONG)
+			{
+				if (Z_LVAL_P(z_value) < 0 || Z_LVAL_P(z_value) > std::numeric_limits<uint32_t>::max())
+				{
+					zend_error(E_WARNING, "Value %ld is out of IPv4 range for column '%s'", Z_LVAL_P(z_value), ZSTR_VAL(name));
+					return false;
+				}
+
+				address.s_addr = htonl(static_cast<uint32_t>(Z_LVAL_P(z_value)));
+			}
+			else if (php_type == IS_STRING && inet_pton(AF_INET, Z_STRVAL_P(z_value), &address) != 1)
+			{
+				zend_error(E_WARNING, "Invalid IPv4 value '%s' for column '%s'", Z_STRVAL_P(z_value), ZSTR_VAL(name));
+				return false;
+			}
+
+			add_value<ColumnIPv4>(block, name, index, address, nullable, php_type == IS_NULL);
+			break;
+		}
+		case Type::Code::IPv6:
+		{
+			in6_addr address{};
+			if (php_type == IS_STRING && inet_pton(AF_INET6, Z_STRVAL_P(z_value), &address) != 1)
+			{
+				zend_error(E_WARNING, "Invalid IPv6 value '%s' for column '%s'", Z_STRVAL_P(z_value), ZSTR_VAL(name));
+				return false;
+			}
+
+			add_value<ColumnIPv6>(block, name, index, &address, nullable, php_type == IS_NULL);
+			break;
+		}
 //		case Type::Code::Int128:
 //		case Type::Code::Decimal:
 //		case Type::Code::Decimal32:
@@ -513,6 +1602,20 @@ auto ClickHouseDB::add_by_type(Block &block, zend_string *name, zend_ulong index
 	return true;
 }
 
+void ClickHouseDB::get_stats(zval *array) const
+{
+	this->stats->to_array(array);
+}
+
+auto ClickHouseDB::set_type_mapping(zend_long mapping) -> bool
+{
+	if (!ClickHouseResult::check_type_mapping(mapping))
+		return false;
+
+	this->type_mapping = mapping;
+	return true;
+}
+
 auto ClickHouseDB::is_connected() const -> bool
 {
 	if (this->client)
@@ -548,6 +1651,222 @@ void ClickHouseDB::set_affected_rows(zend_long value) const
 #endif
 }
 
+auto ClickHouseDB::parse_settings(zend_array *array, ServerSettings &settings) -> bool
+{
+	Bucket *bucket;
+	ZEND_HASH_FOREACH_BUCKET(array, bucket)
+	{
+		if (bucket->key == nullptr)
+		{
+			zend_error(E_WARNING, "Setting name must be string but got number %lu", bucket->h);
+			return false;
+		}
+
+		string_view name(ZSTR_VAL(bucket->key), ZSTR_LEN(bucket->key));
+
+		// Names are also written to SETTINGS clause of INSERT query as is
+		bool valid = !name.empty() && std::all_of(name.begin(), name.end(), [] (char c)
+		{
+			return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '_';
+		});
+		if (!valid)
+		{
+			zend_error(E_WARNING, "Invalid setting name '%s'", ZSTR_VAL(bucket->key));
+			return false;
+		}
+
+		string value;
+
+		switch (Z_TYPE(bucket->val))
+		{
+			case IS_STRING:
+				value.assign(Z_STRVAL(bucket->val), Z_STRLEN(bucket->val));
+				break;
+			case IS_LONG:
+				value = std::to_string(Z_LVAL(bucket->val));
+				break;
+			case IS_DOUBLE:
+			{
+				zend_string *str = zval_get_string(&bucket->val);
+				value.assign(ZSTR_VAL(str), ZSTR_LEN(str));
+				zend_string_release(str);
+				break;
+			}
+			case IS_TRUE:
+				value = "1";
+				break;
+			case IS_FALSE:
+				value = "0";
+				break;
+			default:
+				zend_error(E_WARNING, "Setting '%s' must be string, number or bool but got type %d", ZSTR_VAL(bucket->key), Z_TYPE(bucket->val));
+				return false;
+		}
+
+		// ReSharper disable once CppTooWideScopeInitStatement
+		auto iter = std::find_if(settings.begin(), settings.end(), [&name] (const pair<string, string> &setting)
+		{
+			return setting.first == name;
+		});
+		if (iter != settings.end())
+			iter->second = std::move(value);
+		else
+			settings.emplace_back(name, std::move(value));
+	}
+	ZEND_HASH_FOREACH_END();
+
+	return true;
+}
+
+auto ClickHouseDB::parse_external_tables(zend_array *array, ExternalTables &tables) -> bool
+{
+	zend_string *name;
+	zval *table;
+	ZEND_HASH_FOREACH_STR_KEY_VAL(array, name, table)
+	{
+		if (name == nullptr)
+		{
+			zend_error(E_WARNING, "External table name must be string");
+			return false;
+		}
+
+		zval *structure = (Z_TYPE_P(table) == IS_ARRAY) ? zend_hash_str_find(Z_ARR_P(table), "structure", sizeof("structure") - 1) : nullptr;
+		zval *rows = (Z_TYPE_P(table) == IS_ARRAY) ? zend_hash_str_find(Z_ARR_P(table), "rows", sizeof("rows") - 1) : nullptr;
+
+		if (structure == nullptr || Z_TYPE_P(structure) != IS_STRING || rows == nullptr || Z_TYPE_P(rows) != IS_ARRAY)
+		{
+			zend_error(E_WARNING, "External table '%s' must be array with 'structure' string and 'rows' array", ZSTR_VAL(name));
+			return false;
+		}
+
+		ExternalTable external{string(ZSTR_VAL(name), ZSTR_LEN(name)), Block()};
+
+		try
+		{
+			if (!ClickHouseDB::convert_external_table(string_view(Z_STRVAL_P(structure), Z_STRLEN_P(structure)), Z_ARR_P(rows), external.data))
+				return false;
+		}
+		catch (std::exception &e)
+		{
+			zend_error(E_WARNING, "Failed to convert external table '%s': %s", ZSTR_VAL(name), e.what());
+			return false;
+		}
+
+		tables.push_back(std::move(external));
+	}
+	ZEND_HASH_FOREACH_END();
+
+	return true;
+}
+
+auto ClickHouseDB::convert_external_table(const string_view &structure, zend_array *rows, Block &block) -> bool
+{
+	Block description_block;
+
+	vector<zend_string*> names;
+
+	zval column_names;
+	array_init(&column_names);
+
+	// Structure is "name Type, name Type", commas inside of types like Decimal(10, 2) are skipped
+	bool valid = true;
+	size_t depth = 0;
+	size_t start = 0;
+
+	for (size_t i = 0; i <= structure.size() && valid; i++)
+	{
+		if (i < structure.size())
+		{
+			if (structure[i] == '(')
+				depth++;
+			else if (structure[i] == ')' && depth > 0)
+				depth--;
+
+			if (structure[i] != ',' || depth != 0)
+				continue;
+		}
+
+		string_view column = structure.substr(start, i - start);
+		start = i + 1;
+
+		size_t name_start = column.find_first_not_of(" \t\r\n");
+		size_t name_end = (name_start == string_view::npos) ? string_view::npos : column.find_first_of(" \t\r\n", name_start);
+		size_t type_start = (name_end == string_view::npos) ? string_view::npos : column.find_first_not_of(" \t\r\n", name_end);
+		if (type_start == string_view::npos)
+		{
+			zend_error(E_WARNING, "Invalid column definition '%.*s' in external table structure", static_cast<int>(column.size()), column.data());
+			valid = false;
+			break;
+		}
+
+		string_view column_name = column.substr(name_start, name_end - name_start);
+		if (column_name.size() > 1 && column_name.front() == '`' && column_name.back() == '`')
+			column_name = column_name.substr(1, column_name.size() - 2);
+
+		string_view type = column.substr(type_start, column.find_last_not_of(" \t\r\n") + 1 - type_start);
+
+		ColumnRef description = CreateColumnByType(string(type));
+		if (description == nullptr)
+		{
+			zend_error(E_WARNING, "Unsupported type '%.*s' of external table column '%.*s'", static_cast<int>(type.size()), type.data(), static_cast<int>(column_name.size()), column_name.data());
+			valid = false;
+			break;
+		}
+
+		zend_string *zname = zend_string_init(column_name.data(), column_name.size(), false);
+		names.push_back(zname);
+
+		if (!ClickHouseDB::set_column_index(Z_ARR(column_names), zname))
+		{
+			zend_error(E_WARNING, "External table column '%s' listed twice", ZSTR_VAL(zname));
+			valid = false;
+			break;
+		}
+
+		// Columns are created in structure order, so rows with string keys can list them in any order
+		description_block.AppendColumn(string(column_name), description);
+		block.AppendColumn(string(column_name), CreateColumnByType(string(type)));
+	}
+
+	if (valid && names.empty())
+	{
+		zend_error(E_WARNING, "External table structure is empty");
+		valid = false;
+	}
+
+	if (valid)
+	{
+		bool numeric_keys = true;
+
+		// ReSharper disable once CppTooWideScopeInitStatement
+		zval *first_row = zend_hash_index_find(rows, 0);
+		if (first_row != nullptr && Z_TYPE_P(first_row) == IS_ARRAY)
+		{
+			zend_string *key;
+			ZEND_HASH_FOREACH_STR_KEY(Z_ARR_P(first_row), key)
+			{
+				numeric_keys = (key == nullptr);
+				break;
+			}
+			ZEND_HASH_FOREACH_END();
+		}
+
+		zend_long rows_count = 0;
+		valid = ClickHouseDB::convert_rows(rows, names, Z_ARR(column_names), numeric_keys, description_block, block, rows_count);
+	}
+
+	zend_array_destroy(Z_ARR(column_names));
+
+	for (zend_string *zname : names)
+		zend_string_release(zname);
+
+	if (!valid)
+		return false;
+
+	block.RefreshRowCount();
+	return true;
+}
+
 auto ClickHouseDB::parse_fields(zend_array *fields, vector<zend_string *> &data) -> bool
 {
 	if (fields == nullptr)
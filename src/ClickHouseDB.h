@@ -1,7 +1,16 @@
 #pragma once
 
+#include "ClickHouseExport.h"
+#include "ClickHousePipeline.h"
+#include "ClickHouseAsyncWriter.h"
+#include "ClickHouseCache.h"
+#include "ClickHouseSlowLog.h"
+#include "ClickHouseParallelQuery.h"
+
 class ClickHouseDB
 {
+	friend struct ClickHouseBenchmark;
+
 private:
 	static constexpr uint32_t DEFAULT_PORT = 9000;
 
@@ -14,11 +23,54 @@ private:
 
 	shared_ptr<Client> client;
 
+	// Kept for connections of the async insert writer
+	ClientOptions options;
+
+	// Defaults for all queries of the connection, overridden by settings of a call
+	ServerSettings settings;
+
 	long int timezone_offset;
 
+	// Type mapping flags added to result mode of each query
+	zend_long type_mapping;
+
+	shared_ptr<ClickHouseStats> stats;
+
+	// Unbuffered result owns the connection until all its blocks are received
+	mutable weak_ptr<ClickHousePipeline> pipeline;
+
+	// Query started by start_query(), its blocks are collected by process_io() while PHP does other work
+	struct PendingQuery
+	{
+		shared_ptr<ClickHousePipeline> pipeline;
+		zend_long resultmode;
+
+		deque<Block> blocks;
+		size_t rows_count;
+	};
+	mutable std::unique_ptr<PendingQuery> pending;
+
+	// Event counter of the pending query, readable when process_io() has something to do
+	mutable int notify_fd;
+
+	// Connections of query_parallel() by host and port, kept for next calls
+	mutable unordered_map<string, shared_ptr<Client>> shard_clients;
+
 	[[nodiscard]] auto is_connected() const -> bool;
 
-	[[nodiscard]] auto do_insert(const string &table_name, zend_array *values, zend_array *fields) const -> bool;
+	void finish_pipeline() const;
+
+	// Reconnect after a failed call, timed as a connect
+	void reset_connection() const;
+
+	[[nodiscard]] auto query_cached(const string &key, zend_long resultmode) const -> zend_object*;
+	[[nodiscard]] auto query_unbuffered(const string &query, zend_long resultmode, const ServerSettings &query_settings, ExternalTables tables, bool &success) const -> zend_object*;
+
+	[[nodiscard]] auto do_insert(const string &table_name, zend_array *values, zend_array *fields, const ServerSettings &insert_settings, bool async, ClickHouseSlowLog &slow_log) const -> bool;
+
+	[[nodiscard]] auto parse_endpoints(zend_array *endpoints, vector<ClickHouseParallelQuery::Shard> &shards) const -> bool;
+
+	[[nodiscard]] auto describe_columns(const string &table_name, const string &columns, Block &description) const -> bool;
 
 	void set_error(zend_long code, const char *message) const;
 	void set_affected_rows(zend_long value) const;
@@ -28,19 +80,49 @@ private:
 
 	static void add_fixed_string(Block &block, const zend_string *name, zend_ulong index, const string_view &value, zend_long size, bool nullable, bool is_null);
 
+	template<class T>
+	static void add_enum(Block &block, const zend_string *name, zend_ulong index, const TypeRef &type, int16_t value, bool nullable, bool is_null);
+
+	[[nodiscard]] static auto parse_settings(zend_array *array, ServerSettings &settings) -> bool;
+
+	[[nodiscard]] static auto parse_external_tables(zend_array *array, ExternalTables &tables) -> bool;
+	[[nodiscard]] static auto convert_external_table(const string_view &structure, zend_array *rows, Block &block) -> bool;
+
 	[[nodiscard]] static auto parse_fields(zend_array *fields, vector<zend_string *> &data) -> bool;
 
 	[[nodiscard]] static auto set_column_index(zend_array *names, zend_string *name) -> bool;
 
-	[[nodiscard]] static auto add_by_type(Block &block, zend_string *name, zend_ulong index, zval *z_value, const ColumnRef &description_column, bool nullable = false) -> bool;
+	[[nodiscard]] static auto convert_rows(zend_array *values, const vector<zend_string*> &fields_data, zend_array *column_names, bool numeric_keys, const Block &description_block, Block &block, zend_long &rows) -> bool;
+	[[nodiscard]] static auto convert_values(zend_array *values, const vector<zend_string*> &fields_data, zend_array *column_names, bool numeric_keys, const Block &description_block, const vector<zend_array*> &enum_codes, Block &block, zend_long &rows) -> bool;
+
+	// Codes of Enum values by name for each Enum column of the header, nullptr for other columns
+	[[nodiscard]] static auto build_enum_codes(const Block &description_block) -> vector<zend_array*>;
+
+	[[nodiscard]] static auto add_by_type(Block &block, zend_string *name, zend_ulong index, zval *z_value, const ColumnRef &description_column, const zend_array *enum_codes = nullptr, bool nullable = false) -> bool;
 
 public:
 	explicit ClickHouseDB(zend_object *zend_this);
+	~ClickHouseDB();
+
+	ClickHouseDB(const ClickHouseDB&) = delete;
+	auto operator=(const ClickHouseDB&) -> ClickHouseDB& = delete;
+
+	void connect(const zend_string *host, const zend_string *username, const zend_string *passwd, const zend_string *dbname, zend_long port, zend_array *connection_settings);
+
+	[[nodiscard]] auto query(const string &query, zend_long resultmode, zend_array *query_settings, zend_long cache_ttl, zend_array *external_tables, bool &success) const -> zend_object*;
+	[[nodiscard]] auto query_to_stream(const string &query, php_stream *stream, ClickHouseExport::Format format) const -> bool;
+	[[nodiscard]] auto insert(const string &table_name, zend_array *values, zend_array *fields, zend_array *insert_settings, bool async) const -> bool;
 
-	void connect(const zend_string *host, const zend_string *username, const zend_string *passwd, const zend_string *dbname, zend_long port);
+	[[nodiscard]] auto start_query(const string &query, zend_long resultmode, zend_array *query_settings) const -> bool;
+	[[nodiscard]] auto get_notify_fd() const -> int;
+	[[nodiscard]] auto process_io() const -> bool;
+	[[nodiscard]] auto get_result(bool &success) const -> zend_object*;
 
-	[[nodiscard]] auto query(const string &query, bool &success) const -> zend_object*;
-	[[nodiscard]] auto insert(const string &table_name, zend_array *values, zend_array *fields) const -> bool;
+	[[nodiscard]] auto query_parallel(const string &query, zend_array *endpoints, zend_long merge, const zend_string *key, zend_long resultmode, zend_array *query_settings, bool &success) const -> zend_object*;
+
+	void get_stats(zval *array) const;
+
+	[[nodiscard]] auto set_type_mapping(zend_long mapping) -> bool;
 };
 
 template<class T, class V>
@@ -59,6 +141,37 @@ void ClickHouseDB::add_value(Block &block, zend_string *name, zend_ulong index,
 			block.AppendColumn(string(ZSTR_VAL(name), ZSTR_LEN(name)), make_shared<T>());
 	}
 
+	if (nullable)
+	{
+		auto column = block[index]->As<ColumnNullable>();
+
+		column->Nested()->As<T>()->Append(value);
+		column->Nulls()->As<ColumnUInt8>()->Append(is_null ? 1 : 0);
+	}
+	else
+		block[index]->As<T>()->Append(value);
+}
+
+template<class T>
+void ClickHouseDB::add_enum(Block &block, const zend_string *name, zend_ulong index, const TypeRef &type, int16_t value, bool nullable, bool is_null)
+{
+	if (block.GetColumnCount() <= index)
+	{
+		if (nullable)
+		{
+			auto nested = make_shared<T>(type);
+			auto nulls = make_shared<ColumnUInt8>();
+
+			block.AppendColumn(string(ZSTR_VAL(name), ZSTR_LEN(name)), make_shared<ColumnNullable>(nested, nulls));
+		}
+		else
+			block.AppendColumn(string(ZSTR_VAL(name), ZSTR_LEN(name)), make_shared<T>(type));
+	}
+
+	// Null row still needs a valid code in the nested column
+	if (is_null)
+		value = type->As<EnumType>()->BeginValueToName()->first;
+
 	if (nullable)
 	{
 		auto column = block[index]->As<ColumnNullable>();
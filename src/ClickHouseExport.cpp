@@ -0,0 +1,334 @@
+#include "ClickHouseExport.h"
+
+ClickHouseExport::ClickHouseExport(php_stream *stream, Format format, long int timezone_offset):
+	stream(stream), format(format), timezone_offset(timezone_offset), rows_count(0)
+{
+	this->buffer.reserve(FLUSH_SIZE * 2);
+}
+
+auto ClickHouseExport::write(const Block &block) -> bool
+{
+	size_t columns = block.GetColumnCount();
+	size_t rows = block.GetRowCount();
+
+	if (this->format == Format::JSON_EACH_ROW)
+	{
+		// Keys are the same for each row of the block, escape them once
+		this->keys.resize(columns);
+
+		for (size_t i = 0; i < columns; i++)
+		{
+			string &key = this->keys[i];
+
+			key.assign(i == 0 ? "{" : ",");
+			add_json_string(key, block.GetColumnName(i));
+			key.push_back(':');
+		}
+	}
+
+	for (size_t row = 0; row < rows; row++)
+	{
+		for (size_t i = 0; i < columns; i++)
+		{
+			switch (this->format)
+			{
+				case Format::CSV:
+					if (i != 0)
+						this->buffer.push_back(',');
+					break;
+				case Format::TSV:
+					if (i != 0)
+						this->buffer.push_back('\t');
+					break;
+				case Format::JSON_EACH_ROW:
+					this->buffer.append(this->keys[i]);
+					break;
+			}
+
+			if (!this->add_type(block[i], row))
+				return false;
+		}
+
+		if (this->format == Format::JSON_EACH_ROW)
+			this->buffer.append(columns != 0 ? "}" : "{}");
+
+		this->buffer.push_back('\n');
+
+		if (this->buffer.length() >= FLUSH_SIZE && !this->flush())
+			return false;
+	}
+
+	this->rows_count += rows;
+
+	return this->flush();
+}
+
+auto ClickHouseExport::get_rows_count() const -> size_t
+{
+	return this->rows_count;
+}
+
+auto ClickHouseExport::flush() -> bool
+{
+	if (this->buffer.empty())
+		return true;
+
+	// ReSharper disable once CppTooWideScopeInitStatement
+	auto writed = php_stream_write(this->stream, this->buffer.data(), this->buffer.length());
+	if (writed < 0 || static_cast<size_t>(writed) != this->buffer.length())
+	{
+		zend_error(E_WARNING, "Failed to write %lu bytes to stream", this->buffer.length());
+		return false;
+	}
+
+	this->buffer.clear();
+	return true;
+}
+
+auto ClickHouseExport::add_type(const ColumnRef &column, size_t row) -> bool
+{
+	// ReSharper disable once CppTooWideScope
+	Type::Code type_code = column->Type()->GetCode();
+
+	switch (type_code)
+	{
+//		case Type::Code::Void:
+		case Type::Code::Int8:
+			this->add_long<ColumnInt8>(column, row);
+			break;
+		case Type::Code::Int16:
+			this->add_long<ColumnInt16>(column, row);
+			break;
+		case Type::Code::Int32:
+			this->add_long<ColumnInt32>(column, row);
+			break;
+		case Type::Code::Int64:
+			this->add_long<ColumnInt64>(column, row);
+			break;
+		case Type::Code::UInt8:
+			this->add_long<ColumnUInt8>(column, row);
+			break;
+		case Type::Code::UInt16:
+			this->add_long<ColumnUInt16>(column, row);
+			break;
+		case Type::Code::UInt32:
+			this->add_long<ColumnUInt32>(column, row);
+			break;
+		case Type::Code::UInt64:
+			this->add_long<ColumnUInt64>(column, row);
+			break;
+		case Type::Code::Float32:
+			this->add_float<ColumnFloat32>(column, row);
+			break;
+		case Type::Code::Float64:
+			this->add_float<ColumnFloat64>(column, row);
+			break;
+		case Type::Code::String:
+			this->add_string<ColumnString>(column, row);
+			break;
+		case Type::Code::FixedString:
+			this->add_string<ColumnFixedString>(column, row);
+			break;
+		case Type::Code::DateTime:
+			this->add_date<ColumnDateTime>(column, row);
+			break;
+		case Type::Code::DateTime64:
+			this->add_date<ColumnDateTime64>(column, row);
+			break;
+		case Type::Code::Date:
+			this->add_date<ColumnDate>(column, row);
+			break;
+		case Type::Code::Date32:
+			this->add_date<ColumnDate32>(column, row);
+			break;
+//		case Type::Code::Array:
+		case Type::Code::Nullable:
+		{
+			auto value = column->As<ColumnNullable>();
+
+			if (value->IsNull(row))
+			{
+				this->add_null();
+				break;
+			}
+
+			return this->add_type(value->Nested(), row);
+		}
+//		case Type::Code::Tuple:
+		case Type::Code::Enum8:
+			this->add_quoted(column->As<ColumnEnum8>()->NameAt(row));
+			break;
+		case Type::Code::Enum16:
+			this->add_quoted(column->As<ColumnEnum16>()->NameAt(row));
+			break;
+		case Type::Code::UUID:
+			this->add_string<ColumnUUID>(column, row);
+			break;
+		case Type::Code::IPv4:
+			this->add_string<ColumnIPv4>(column, row);
+			break;
+		case Type::Code::IPv6:
+			this->add_string<ColumnIPv6>(column, row);
+			break;
+		case Type::Code::Int128:
+			this->add_long<ColumnInt128>(column, row);
+			break;
+		case Type::Code::Decimal:
+		case Type::Code::Decimal32:
+		case Type::Code::Decimal64:
+		case Type::Code::Decimal128:
+		{
+			char buffer[FORMAT_BUFFER_SIZE];
+
+			this->buffer.append(buffer, format_decimal(*column->As<ColumnDecimal>(), row, buffer, sizeof(buffer)));
+			break;
+		}
+		case Type::Code::LowCardinality:
+		{
+			auto nested_type = column->As<ColumnLowCardinality>()->GetNestedType();
+
+			// ReSharper disable once CppTooWideScope
+			Type::Code nested_code = nested_type->GetCode();
+
+			switch (nested_code)
+			{
+				case Type::Code::String:
+					this->add_string<ColumnLowCardinalityT<ColumnString>>(column, row);
+					break;
+				default:
+					zend_error(E_WARNING, "Type LowCardinality(%s) (%d) is unsupported", nested_type->GetName().c_str(), nested_code);
+					return false;
+			}
+			break;
+		}
+		default:
+			zend_error(E_WARNING, "Type %s (%d) is unsupported", column->Type()->GetName().c_str(), type_code);
+			return false;
+	}
+
+	return true;
+}
+
+void ClickHouseExport::add_null()
+{
+	if (this->format == Format::JSON_EACH_ROW)
+		this->buffer.append("null");
+	else
+		this->buffer.append("\\N");
+}
+
+void ClickHouseExport::add_quoted(const string_view &value)
+{
+	switch (this->format)
+	{
+		case Format::CSV:
+			this->buffer.push_back('"');
+			add_escaped(this->buffer, value, Format::CSV);
+			this->buffer.push_back('"');
+			break;
+		case Format::TSV:
+			add_escaped(this->buffer, value, Format::TSV);
+			break;
+		case Format::JSON_EACH_ROW:
+			add_json_string(this->buffer, value);
+			break;
+	}
+}
+
+void ClickHouseExport::add_json_string(string &buffer, const string_view &value)
+{
+	buffer.push_back('"');
+	add_escaped(buffer, value, Format::JSON_EACH_ROW);
+	buffer.push_back('"');
+}
+
+void ClickHouseExport::add_escaped(string &buffer, string_view value, Format format)
+{
+	// Most values have nothing to escape, runs between special characters are appended at once
+	while (true)
+	{
+		size_t plain;
+
+		switch (format)
+		{
+			case Format::CSV:
+				plain = find_csv_special(value.data(), value.length());
+				break;
+			case Format::TSV:
+				plain = find_tsv_special(value.data(), value.length());
+				break;
+			case Format::JSON_EACH_ROW:
+			default:
+				plain = find_json_special(value.data(), value.length());
+				break;
+		}
+
+		buffer.append(value.data(), plain);
+
+		if (plain == value.length())
+			return;
+
+		add_escaped_char(buffer, value[plain], format);
+
+		value.remove_prefix(plain + 1);
+	}
+}
+
+void ClickHouseExport::add_escaped_char(string &buffer, char c, Format format)
+{
+	if (format == Format::CSV)
+	{
+		buffer.append("\"\"");
+		return;
+	}
+
+	switch (c)
+	{
+		case '"':
+			buffer.append("\\\"");
+			break;
+		case '\\':
+			buffer.append("\\\\");
+			break;
+		case '\t':
+			buffer.append("\\t");
+			break;
+		case '\n':
+			buffer.append("\\n");
+			break;
+		case '\r':
+			buffer.append("\\r");
+			break;
+		case '\0':
+			if (format == Format::TSV)
+			{
+				buffer.append("\\0");
+				break;
+			}
+			[[fallthrough]];
+		default:
+		{
+			char escaped[7];
+			snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+			buffer.append(escaped, 6);
+		}
+	}
+}
+
+auto ClickHouseExport::get_format(zend_long format, Format &result) -> bool
+{
+	// ReSharper disable once CppTooWideScope
+	auto type = static_cast<Format>(format);
+
+	switch (type)
+	{
+		case Format::CSV:
+		case Format::TSV:
+		case Format::JSON_EACH_ROW:
+			result = type;
+			return true;
+	}
+
+	zend_error(E_WARNING, "Unknown format %lu, CLICKHOUSE_FORMAT_CSV, CLICKHOUSE_FORMAT_TSV or CLICKHOUSE_FORMAT_JSON_EACH_ROW are supported", format);
+	return false;
+}
\ No newline at end of file
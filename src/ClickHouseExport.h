@@ -0,0 +1,128 @@
+#pragma once
+
+#include "util.h"
+
+#include <netinet/in.h>
+
+class ClickHouseExport
+{
+public:
+	enum class Format : uint8_t
+	{
+		CSV = 1,
+		TSV = 2,
+		JSON_EACH_ROW = 3
+	};
+
+private:
+	// Buffer is written to the stream when it grows above this size, even in the middle of a block
+	static constexpr size_t FLUSH_SIZE = 64 * 1024;
+
+	php_stream *stream;
+	Format format;
+	long int timezone_offset;
+
+	string buffer;
+	vector<string> keys;
+
+	size_t rows_count;
+
+	[[nodiscard]] auto flush() -> bool;
+
+	[[nodiscard]] auto add_type(const ColumnRef &column, size_t row) -> bool;
+
+	template<class T>
+	void add_long(const ColumnRef &column, size_t row);
+
+	template<class T>
+	void add_float(const ColumnRef &column, size_t row);
+
+	template<class T>
+	void add_string(const ColumnRef &column, size_t row);
+
+	template<class T>
+	void add_date(const ColumnRef &column, size_t row);
+
+	void add_null();
+	void add_quoted(const string_view &value);
+
+	static void add_escaped(string &buffer, string_view value, Format format);
+	static void add_escaped_char(string &buffer, char c, Format format);
+
+public:
+	ClickHouseExport(php_stream *stream, Format format, long int timezone_offset);
+
+	[[nodiscard]] auto write(const Block &block) -> bool;
+
+	[[nodiscard]] auto get_rows_count() const -> size_t;
+
+	[[nodiscard]] static auto get_format(zend_long format, Format &result) -> bool;
+
+	static void add_json_string(string &buffer, const string_view &value);
+};
+
+template<class T>
+void ClickHouseExport::add_long(const ColumnRef &column, size_t row)
+{
+	auto value = column->As<T>()->At(row);
+
+	char buffer[FORMAT_BUFFER_SIZE];
+
+	if constexpr (std::is_integral_v<decltype(value)>)
+	{
+		auto [end, error] = std::to_chars(buffer, buffer + sizeof(buffer), value);
+		this->buffer.append(buffer, end);
+	}
+	else
+		this->buffer.append(buffer, format_int128(value, buffer, sizeof(buffer)));
+}
+
+template<class T>
+void ClickHouseExport::add_float(const ColumnRef &column, size_t row)
+{
+	auto value = column->As<T>()->At(row);
+
+	if (!std::isfinite(value))
+	{
+		if (this->format == Format::JSON_EACH_ROW)
+			this->buffer.append("null");
+		else if (std::isnan(value))
+			this->buffer.append("nan");
+		else
+			this->buffer.append(value < 0 ? "-inf" : "inf");
+		return;
+	}
+
+	char buffer[32];
+
+	int writed = snprintf(buffer, sizeof(buffer), "%.*g", std::numeric_limits<decltype(value)>::max_digits10, static_cast<double>(value));
+	this->buffer.append(buffer, writed);
+}
+
+template<class T>
+void ClickHouseExport::add_string(const ColumnRef &column, size_t row)
+{
+	auto result = column->As<T>()->At(row);
+
+	char buffer[FORMAT_BUFFER_SIZE];
+
+	if constexpr (std::is_same_v<std::decay_t<decltype(result)>, UUID>)
+		this->add_quoted(string_view(buffer, format_uuid(result, buffer, sizeof(buffer))));
+	else if constexpr (std::is_same_v<std::decay_t<decltype(result)>, in_addr> || std::is_same_v<std::decay_t<decltype(result)>, in6_addr>)
+		this->add_quoted(string_view(buffer, format_ip(result, buffer, sizeof(buffer))));
+	else
+		this->add_quoted(result);
+}
+
+template<class T>
+void ClickHouseExport::add_date(const ColumnRef &column, size_t row)
+{
+	time_t value = column->As<T>()->At(row) + this->timezone_offset;
+
+	char buffer[20];		//2020-01-01 00:00:00 + \0
+	size_t writed = format_date(value, std::is_same<T, ColumnDateTime>{}, buffer, sizeof(buffer));
+	if (writed == 0)
+		zend_error_noreturn(E_ERROR, "Failed to format DateTime to string");
+
+	this->add_quoted(string_view(buffer, writed));
+}
\ No newline at end of file
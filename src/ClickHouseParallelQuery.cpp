@@ -0,0 +1,324 @@
+#include "ClickHouseParallelQuery.h"
+
+#include <queue>
+#include <thread>
+
+void ClickHouseParallelQuery::execute(vector<Shard> &shards, const string &query, const ServerSettings &settings)
+{
+	if (shards.empty())
+		return;
+
+	vector<std::thread> threads;
+	threads.reserve(shards.size() - 1);
+
+	// The last server is queried by the calling thread, it would only wait otherwise
+	for (size_t i = 0; i + 1 < shards.size(); i++)
+	{
+		try
+		{
+			threads.emplace_back(&ClickHouseParallelQuery::run, std::ref(shards[i]), std::cref(query), std::cref(settings));
+		}
+		catch (std::system_error&)
+		{
+			ClickHouseParallelQuery::run(shards[i], query, settings);
+		}
+	}
+
+	ClickHouseParallelQuery::run(shards.back(), query, settings);
+
+	for (std::thread &thread : threads)
+		thread.join();
+}
+
+void ClickHouseParallelQuery::run(Shard &shard, const string &query, const ServerSettings &settings)
+{
+	DecompressStats start_decompression = lz4_get_thread_stats();
+
+	try
+	{
+		if (!shard.client)
+		{
+			uint64_t connect_start = ClickHouseStats::now();
+
+			shard.client = make_shared<Client>(shard.options);
+			shard.connected = true;
+			shard.connect_time += ClickHouseStats::now() - connect_start;
+		}
+
+		Query ch_query(query);
+		apply_settings(ch_query, settings);
+		ch_query.OnData([&shard] (const Block &block)
+		{
+			if (shard.header.GetColumnCount() == 0 && block.GetColumnCount() != 0)
+				shard.header = block;
+
+			if (block.GetRowCount() == 0)
+				return;
+
+			shard.rows_count += block.GetRowCount();
+			shard.blocks.push_back(block);
+		});
+		ch_query.OnProfile([&shard] (const Profile &profile)
+		{
+			shard.bytes_received += profile.bytes;
+		});
+
+		shard.client->Execute(ch_query);
+	}
+	catch (ServerException &e)
+	{
+		shard.error_code = e.GetCode();
+		shard.error_message = e.what();
+	}
+	catch (std::exception &e)
+	{
+		shard.error_message = e.what();
+	}
+
+	shard.decompression = lz4_get_stats_since(start_decompression);
+
+	if (shard.error_message.empty() || !shard.client)
+		return;
+
+	uint64_t connect_start = ClickHouseStats::now();
+
+	try
+	{
+		shard.client->ResetConnection();
+	}
+	catch (std::exception&)
+	{}
+
+	shard.connected = true;
+	shard.connect_time += ClickHouseStats::now() - connect_start;
+}
+
+auto ClickHouseParallelQuery::check_headers(const vector<Shard> &shards, string &message) -> bool
+{
+	const Block *first = nullptr;
+
+	for (const Shard &shard : shards)
+	{
+		if (shard.header.GetColumnCount() == 0)
+			continue;
+
+		if (first == nullptr)
+		{
+			first = &shard.header;
+			continue;
+		}
+
+		bool same = (shard.header.GetColumnCount() == first->GetColumnCount());
+		for (size_t i = 0; same && i < first->GetColumnCount(); i++)
+			same = (shard.header.GetColumnName(i) == first->GetColumnName(i) && shard.header[i]->Type()->GetName() == (*first)[i]->Type()->GetName());
+
+		if (!same)
+		{
+			message = "Columns of the result from " + shard.options.host + ":" + std::to_string(shard.options.port) + " differ from other servers";
+			return false;
+		}
+	}
+
+	return true;
+}
+
+void ClickHouseParallelQuery::concat(vector<Shard> &shards, deque<Block> &blocks)
+{
+	for (Shard &shard : shards)
+	{
+		for (Block &block : shard.blocks)
+			blocks.push_back(std::move(block));
+
+		shard.blocks.clear();
+	}
+}
+
+auto ClickHouseParallelQuery::merge_sorted(vector<Shard> &shards, const string &key, deque<Block> &blocks, string &message) -> bool
+{
+	const Block *header = nullptr;
+	for (const Shard &shard : shards)
+	{
+		if (!shard.blocks.empty())
+		{
+			header = &shard.header;
+			break;
+		}
+	}
+
+	if (header == nullptr)
+		return true;
+
+	size_t key_index = header->GetColumnCount();
+	for (size_t i = 0; i < header->GetColumnCount(); i++)
+	{
+		if (header->GetColumnName(i) == key)
+		{
+			key_index = i;
+			break;
+		}
+	}
+
+	if (key_index == header->GetColumnCount())
+	{
+		message = "Key column '" + key + "' is not in the result";
+		return false;
+	}
+
+	KeyCompare compare = ClickHouseParallelQuery::get_key_compare((*header)[key_index]->Type());
+	if (compare == nullptr)
+	{
+		message = "Key column '" + key + "' of type " + (*header)[key_index]->Type()->GetName() + " can't be used for merging";
+		return false;
+	}
+
+	struct Cursor
+	{
+		size_t shard;
+		size_t block;
+		size_t row;
+		ColumnRef key;
+	};
+
+	// Equal keys are taken in order of endpoints, so the merge is stable
+	auto greater = [compare] (const Cursor &a, const Cursor &b) -> bool
+	{
+		int result = compare(a.key, a.row, b.key, b.row);
+		return result > 0 || (result == 0 && a.shard > b.shard);
+	};
+
+	std::priority_queue<Cursor, vector<Cursor>, decltype(greater)> heap(greater);
+	for (size_t i = 0; i < shards.size(); i++)
+	{
+		if (!shards[i].blocks.empty())
+			heap.push({i, 0, 0, shards[i].blocks[0][key_index]});
+	}
+
+	Block merged = ClickHouseParallelQuery::clone_empty(*header);
+
+	while (!heap.empty())
+	{
+		Cursor cursor = heap.top();
+		heap.pop();
+
+		deque<Block> &shard_blocks = shards[cursor.shard].blocks;
+		size_t rows = shard_blocks[cursor.block].GetRowCount();
+
+		// Rows are copied in runs, while they are not greater than the next row of other servers
+		Cursor end = cursor;
+		if (heap.empty())
+			end.row = rows;
+		else
+		{
+			for (end.row++; end.row < rows && !greater(end, heap.top()); end.row++)
+			{}
+		}
+
+		ClickHouseParallelQuery::append_rows(merged, shard_blocks[cursor.block], cursor.row, end.row - cursor.row);
+
+		if (merged.GetRowCount() >= MERGED_BLOCK_ROWS)
+		{
+			blocks.push_back(std::move(merged));
+			merged = ClickHouseParallelQuery::clone_empty(*header);
+		}
+
+		cursor.row = end.row;
+		if (cursor.row == rows)
+		{
+			// Copied block is released right away, so memory of the result is not held twice
+			shard_blocks[cursor.block] = Block();
+
+			cursor.block++;
+			cursor.row = 0;
+
+			if (cursor.block == shard_blocks.size())
+				continue;
+
+			cursor.key = shard_blocks[cursor.block][key_index];
+		}
+
+		heap.push(std::move(cursor));
+	}
+
+	if (merged.GetRowCount() != 0)
+		blocks.push_back(std::move(merged));
+
+	for (Shard &shard : shards)
+		shard.blocks.clear();
+
+	return true;
+}
+
+auto ClickHouseParallelQuery::get_key_compare(const TypeRef &type) -> KeyCompare
+{
+	switch (type->GetCode())
+	{
+		case Type::Code::Int8:
+			return &ClickHouseParallelQuery::compare_keys<ColumnInt8>;
+		case Type::Code::Int16:
+			return &ClickHouseParallelQuery::compare_keys<ColumnInt16>;
+		case Type::Code::Int32:
+			return &ClickHouseParallelQuery::compare_keys<ColumnInt32>;
+		case Type::Code::Int64:
+			return &ClickHouseParallelQuery::compare_keys<ColumnInt64>;
+		case Type::Code::Int128:
+			return &ClickHouseParallelQuery::compare_keys<ColumnInt128>;
+		case Type::Code::UInt8:
+			return &ClickHouseParallelQuery::compare_keys<ColumnUInt8>;
+		case Type::Code::UInt16:
+			return &ClickHouseParallelQuery::compare_keys<ColumnUInt16>;
+		case Type::Code::UInt32:
+			return &ClickHouseParallelQuery::compare_keys<ColumnUInt32>;
+		case Type::Code::UInt64:
+			return &ClickHouseParallelQuery::compare_keys<ColumnUInt64>;
+		case Type::Code::Float32:
+			return &ClickHouseParallelQuery::compare_keys<ColumnFloat32>;
+		case Type::Code::Float64:
+			return &ClickHouseParallelQuery::compare_keys<ColumnFloat64>;
+		case Type::Code::String:
+			return &ClickHouseParallelQuery::compare_keys<ColumnString>;
+		case Type::Code::FixedString:
+			return &ClickHouseParallelQuery::compare_keys<ColumnFixedString>;
+		case Type::Code::DateTime:
+			return &ClickHouseParallelQuery::compare_keys<ColumnDateTime>;
+		case Type::Code::DateTime64:
+			return &ClickHouseParallelQuery::compare_keys<ColumnDateTime64>;
+		case Type::Code::Date:
+			return &ClickHouseParallelQuery::compare_keys<ColumnDate>;
+		case Type::Code::Date32:
+			return &ClickHouseParallelQuery::compare_keys<ColumnDate32>;
+		// Enums are sorted by codes, as ClickHouse does
+		case Type::Code::Enum8:
+			return &ClickHouseParallelQuery::compare_keys<ColumnEnum8>;
+		case Type::Code::Enum16:
+			return &ClickHouseParallelQuery::compare_keys<ColumnEnum16>;
+		case Type::Code::UUID:
+			return &ClickHouseParallelQuery::compare_keys<ColumnUUID>;
+		case Type::Code::Decimal:
+		case Type::Code::Decimal32:
+		case Type::Code::Decimal64:
+		case Type::Code::Decimal128:
+			return &ClickHouseParallelQuery::compare_keys<ColumnDecimal>;
+		default:
+			return nullptr;
+	}
+}
+
+void ClickHouseParallelQuery::append_rows(Block &target, const Block &source, size_t begin, size_t count)
+{
+	bool whole_block = (begin == 0 && count == source.GetRowCount());
+
+	for (size_t i = 0; i < source.GetColumnCount(); i++)
+		target[i]->Append(whole_block ? source[i] : source[i]->Slice(begin, count));
+
+	target.RefreshRowCount();
+}
+
+auto ClickHouseParallelQuery::clone_empty(const Block &header) -> Block
+{
+	Block block;
+
+	for (size_t i = 0; i < header.GetColumnCount(); i++)
+		block.AppendColumn(header.GetColumnName(i), header[i]->CloneEmpty());
+
+	return block;
+}
\ No newline at end of file
@@ -0,0 +1,75 @@
+#pragma once
+
+#include "util.h"
+
+// Runs the same query on several servers at once, each on its own thread and connection, and merges their blocks
+// into one result. Wall time is close to the slowest server, threads work only with clickhouse-cpp and never call Zend API.
+class ClickHouseParallelQuery
+{
+public:
+	enum class Merge : zend_long
+	{
+		// Blocks of each server one after another, in order of endpoints
+		CONCAT = 0,
+		// Rows ordered by the key column, each server must return rows sorted by it
+		SORTED = 1
+	};
+
+	struct Shard
+	{
+		ClientOptions options;
+
+		// Reused between calls, created by the thread if there is no connection yet
+		shared_ptr<Client> client;
+		bool connected = false;
+		// New connection or reconnect after a failure
+		uint64_t connect_time = 0;
+
+		Block header;
+		deque<Block> blocks;
+		size_t rows_count = 0;
+		uint64_t bytes_received = 0;
+		DecompressStats decompression{};
+
+		int32_t error_code = 0;
+		string error_message;
+	};
+
+private:
+	static constexpr size_t MERGED_BLOCK_ROWS = 65536;
+
+	using KeyCompare = int (*)(const ColumnRef &a, size_t a_row, const ColumnRef &b, size_t b_row);
+
+	static void run(Shard &shard, const string &query, const ServerSettings &settings);
+
+	[[nodiscard]] static auto get_key_compare(const TypeRef &type) -> KeyCompare;
+
+	template<class T>
+	[[nodiscard]] static auto compare_keys(const ColumnRef &a, size_t a_row, const ColumnRef &b, size_t b_row) -> int;
+
+	static void append_rows(Block &target, const Block &source, size_t begin, size_t count);
+	[[nodiscard]] static auto clone_empty(const Block &header) -> Block;
+
+public:
+	// Returns when all servers have finished, errors are left in the shards
+	static void execute(vector<Shard> &shards, const string &query, const ServerSettings &settings);
+
+	// Columns of all servers must match, empty message if they do
+	[[nodiscard]] static auto check_headers(const vector<Shard> &shards, string &message) -> bool;
+
+	static void concat(vector<Shard> &shards, deque<Block> &blocks);
+	[[nodiscard]] static auto merge_sorted(vector<Shard> &shards, const string &key, deque<Block> &blocks, string &message) -> bool;
+};
+
+template<class T>
+auto ClickHouseParallelQuery::compare_keys(const ColumnRef &a, size_t a_row, const ColumnRef &b, size_t b_row) -> int
+{
+	auto a_value = a->As<T>()->At(a_row);
+	auto b_value = b->As<T>()->At(b_row);
+
+	if (a_value < b_value)
+		return -1;
+	if (b_value < a_value)
+		return 1;
+	return 0;
+}
\ No newline at end of file
@@ -0,0 +1,273 @@
+#include "ClickHousePipeline.h"
+#include "probes.h"
+
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+
+extern "C"
+{
+	auto __real_recv(int fd, void *buffer, size_t length, int flags) -> ssize_t;
+	auto __wrap_recv(int fd, void *buffer, size_t length, int flags) -> ssize_t;
+}
+
+// Set only on pipeline threads, clickhouse-cpp reads the socket with recv() and doesn't expose its descriptor
+static thread_local ClickHousePipeline *receiving_pipeline = nullptr;
+
+auto __wrap_recv(int fd, void *buffer, size_t length, int flags) -> ssize_t
+{
+	if (receiving_pipeline != nullptr)
+		receiving_pipeline->on_receive(fd);
+
+	return __real_recv(fd, buffer, length, flags);
+}
+
+ClickHousePipeline::ClickHousePipeline(shared_ptr<Client> client, const string &query, const ServerSettings &settings, ExternalTables tables, int notify_fd):
+	client(std::move(client)), header_received(false), has_data(false), finished(false), canceled(false), socket_fd(-1), receiving(false), interrupted(false), error_code(0), bytes_received(0), decompression(), connect_time(0), notify_fd(notify_fd)
+{
+	this->thread = std::thread(&ClickHousePipeline::run, this, query, settings, std::move(tables));
+}
+
+ClickHousePipeline::~ClickHousePipeline()
+{
+	this->cancel();
+}
+
+void ClickHousePipeline::run(const string &query, const ServerSettings &settings, const ExternalTables &tables)
+{
+	DecompressStats start_decompression = lz4_get_thread_stats();
+
+	{
+		std::lock_guard lock(this->mutex);
+		this->receiving = !this->canceled;
+	}
+
+	receiving_pipeline = this;
+
+	try
+	{
+		auto on_data = [this] (const Block &block) -> bool
+		{
+			bool continue_query;
+			this->push(block, continue_query);
+			return continue_query;
+		};
+
+		if (tables.empty())
+		{
+			Query ch_query(query);
+			apply_settings(ch_query, settings);
+			ch_query.OnDataCancelable(on_data);
+			ch_query.OnProfile([this] (const Profile &profile)
+			{
+				std::lock_guard lock(this->mutex);
+				this->bytes_received += profile.bytes;
+			});
+
+			this->client->Execute(ch_query);
+		}
+		else
+			this->client->SelectWithExternalDataCancelable(query, tables, on_data);
+	}
+	catch (ServerException &e)
+	{
+		std::lock_guard lock(this->mutex);
+
+		this->error_code = e.GetCode();
+		this->error_message = e.what();
+	}
+	catch (std::exception &e)
+	{
+		std::lock_guard lock(this->mutex);
+
+		this->error_message = e.what();
+	}
+
+	receiving_pipeline = nullptr;
+
+	// Socket shut down by cancel() can't be used anymore even if the query has managed to finish
+	bool failed;
+	{
+		std::lock_guard lock(this->mutex);
+		this->receiving = false;
+		failed = !this->error_message.empty() || this->interrupted;
+	}
+
+	uint64_t connect_start = ClickHouseStats::now();
+	if (failed)
+	{
+		try
+		{
+			this->client->ResetConnection();
+		}
+		catch (std::exception&)
+		{}
+	}
+
+	std::lock_guard lock(this->mutex);
+
+	this->decompression = lz4_get_stats_since(start_decompression);
+	if (failed)
+		this->connect_time = ClickHouseStats::now() - connect_start;
+
+	this->header_received = true;
+	this->finished = true;
+
+	this->condition.notify_all();
+	this->notify();
+}
+
+void ClickHousePipeline::notify() const
+{
+	if (this->notify_fd != -1)
+		eventfd_write(this->notify_fd, 1);
+}
+
+void ClickHousePipeline::push(const Block &block, bool &continue_query)
+{
+	std::unique_lock lock(this->mutex);
+
+	if (!this->header_received)
+	{
+		this->header_received = true;
+		this->has_data = (block.GetColumnCount() != 0);
+
+		this->condition.notify_all();
+	}
+
+	continue_query = !this->canceled;
+
+	if (block.GetRowCount() == 0 || this->canceled)
+		return;
+
+	CLICKHOUSE_PROBE(block__received, block.GetRowCount(), block.GetColumnCount());
+
+	this->condition.wait(lock, [this] { return this->queue.size() < QUEUE_SIZE || this->canceled; });
+
+	continue_query = !this->canceled;
+	if (!continue_query)
+		return;
+
+	this->queue.push_back(block);
+	this->condition.notify_all();
+	this->notify();
+}
+
+auto ClickHousePipeline::wait_header(bool &has_data) -> bool
+{
+	std::unique_lock lock(this->mutex);
+
+	this->condition.wait(lock, [this] { return this->header_received; });
+
+	has_data = this->has_data;
+	return this->error_message.empty() || this->has_data;
+}
+
+auto ClickHousePipeline::pop(Block &block) -> bool
+{
+	std::unique_lock lock(this->mutex);
+
+	this->condition.wait(lock, [this] { return !this->queue.empty() || this->finished; });
+
+	if (this->queue.empty())
+		return false;
+
+	block = std::move(this->queue.front());
+	this->queue.pop_front();
+
+	this->condition.notify_all();
+	return true;
+}
+
+auto ClickHousePipeline::try_pop(Block &block) -> bool
+{
+	std::lock_guard lock(this->mutex);
+
+	if (this->queue.empty())
+		return false;
+
+	block = std::move(this->queue.front());
+	this->queue.pop_front();
+
+	this->condition.notify_all();
+	return true;
+}
+
+void ClickHousePipeline::cancel()
+{
+	{
+		std::lock_guard lock(this->mutex);
+
+		this->canceled = true;
+		this->queue.clear();
+
+		// Thread waiting for the server would not see the flag until the next packet, the read fails right away instead
+		if (this->receiving)
+			this->interrupt();
+
+		this->condition.notify_all();
+	}
+
+	if (this->thread.joinable())
+		this->thread.join();
+}
+
+void ClickHousePipeline::on_receive(int fd)
+{
+	std::lock_guard lock(this->mutex);
+
+	this->socket_fd = fd;
+
+	// Canceled before the first read, the socket was not known then
+	if (this->canceled)
+		this->interrupt();
+}
+
+void ClickHousePipeline::interrupt()
+{
+	if (this->interrupted || this->socket_fd == -1)
+		return;
+
+	shutdown(this->socket_fd, SHUT_RDWR);
+	this->interrupted = true;
+}
+
+auto ClickHousePipeline::is_finished() -> bool
+{
+	std::lock_guard lock(this->mutex);
+
+	return this->finished;
+}
+
+auto ClickHousePipeline::get_error(int32_t &code, string &message) -> bool
+{
+	std::lock_guard lock(this->mutex);
+
+	if (this->error_message.empty())
+		return false;
+
+	code = this->error_code;
+	message = this->error_message;
+	return true;
+}
+
+auto ClickHousePipeline::get_bytes_received() -> uint64_t
+{
+	std::lock_guard lock(this->mutex);
+
+	return this->bytes_received;
+}
+
+void ClickHousePipeline::add_thread_stats(ClickHouseStats *stats)
+{
+	std::lock_guard lock(this->mutex);
+
+	clickhouse_stats_add_decompression(stats, this->decompression);
+	this->decompression = {};
+
+	if (this->connect_time != 0)
+	{
+		clickhouse_stats_add(stats, &ClickHouseStats::connects, 1);
+		clickhouse_stats_add(stats, &ClickHouseStats::connect_time, this->connect_time);
+		this->connect_time = 0;
+	}
+}
\ No newline at end of file
@@ -0,0 +1,80 @@
+#pragma once
+
+#include "util.h"
+
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+// Runs query on a separate thread and passes received blocks to PHP thread through a bounded queue.
+// Socket reads, decompression and block decoding overlap with conversion in PHP thread, the thread never calls Zend API.
+class ClickHousePipeline
+{
+private:
+	static constexpr size_t QUEUE_SIZE = 4;
+
+	shared_ptr<Client> client;
+
+	std::mutex mutex;
+	std::condition_variable condition;
+
+	deque<Block> queue;
+	bool header_received;
+	bool has_data;
+	bool finished;
+	bool canceled;
+
+	// Socket of the last read of the pipeline thread, cancel() shuts it down to interrupt a read waiting for the server
+	int socket_fd;
+	bool receiving;
+	bool interrupted;
+
+	int32_t error_code;
+	string error_message;
+
+	uint64_t bytes_received;
+	DecompressStats decompression;
+
+	// Reconnect of the pipeline thread after a failed query, 0 if there was none
+	uint64_t connect_time;
+
+	// Event counter written on each new block and on finish, for event loops polling the query instead of waiting
+	int notify_fd;
+
+	std::thread thread;
+
+	void run(const string &query, const ServerSettings &settings, const ExternalTables &tables);
+	void push(const Block &block, bool &continue_query);
+	void notify() const;
+	void interrupt();
+
+public:
+	ClickHousePipeline(shared_ptr<Client> client, const string &query, const ServerSettings &settings, ExternalTables tables, int notify_fd = -1);
+	~ClickHousePipeline();
+
+	ClickHousePipeline(const ClickHousePipeline&) = delete;
+	auto operator=(const ClickHousePipeline&) -> ClickHousePipeline& = delete;
+
+	// Waits for the first block with columns description, false if the query has failed
+	[[nodiscard]] auto wait_header(bool &has_data) -> bool;
+
+	// Waits for the next block, false after the last one or on error
+	[[nodiscard]] auto pop(Block &block) -> bool;
+
+	// Takes the next block if there is one already, never waits
+	[[nodiscard]] auto try_pop(Block &block) -> bool;
+
+	// Interrupts a read blocked on the socket, the pipeline thread reconnects before finishing then
+	void cancel();
+
+	// Called from recv() of the pipeline thread before it reads the socket
+	void on_receive(int fd);
+
+	// Finished pipeline doesn't use the connection anymore, some blocks can still be in the queue
+	[[nodiscard]] auto is_finished() -> bool;
+	[[nodiscard]] auto get_error(int32_t &code, string &message) -> bool;
+	[[nodiscard]] auto get_bytes_received() -> uint64_t;
+
+	// Decompression and reconnect of the pipeline thread, called by PHP thread once the pipeline is finished or canceled
+	void add_thread_stats(ClickHouseStats *stats);
+};
\ No newline at end of file
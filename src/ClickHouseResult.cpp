@@ -1,11 +1,42 @@
 #include "ClickHouseResult.h"
 
-ClickHouseResult::ClickHouseResult(zend_object *zend_this, deque<Block> blocks, size_t rows_count, long int timezone_offset):
-	zend_this(zend_this), blocks(std::move(blocks)), next_row(0), timezone_offset(timezone_offset)
+#include "probes.h"
+
+ClickHouseResult::ClickHouseResult(zend_object *zend_this, deque<Block> blocks, deque<BlockStrings> strings, size_t rows_count, long int timezone_offset, zend_long resultmode, shared_ptr<ClickHouseStats> stats, shared_ptr<ClickHousePipeline> pipeline, std::unique_ptr<ClickHouseBlockStore> store):
+	zend_this(zend_this), blocks(std::move(blocks)), strings(std::move(strings)), current_strings(nullptr), direct_strings((resultmode & DIRECT_STRINGS) != 0), pipeline(std::move(pipeline)), store(std::move(store)), seekable((resultmode & SEEKABLE_RESULT) != 0), current_block(0), rows_count(rows_count), next_row(0), position(0), timezone_offset(timezone_offset), iterator_type(FetchType::ASSOC), row_time(0), numeric_first_row(0), numeric_rows(0), value_getter(get_value_getter(resultmode)), stats(std::move(stats)), properties_class(nullptr)
 {
+	if (this->seekable)
+	{
+		this->offsets.reserve(this->blocks.size());
+
+		size_t offset = 0;
+		for (const Block &block : this->blocks)
+		{
+			this->offsets.push_back(offset);
+			offset += block.GetRowCount();
+		}
+	}
+
 	this->set_num_rows(rows_count);
 }
 
+ClickHouseResult::~ClickHouseResult()
+{
+	this->release_properties();
+
+	for (BlockStrings &block_strings : this->strings)
+		release_strings(block_strings);
+
+	for (EnumNames &column_names : this->enum_names)
+	{
+		for (zend_string *name : column_names.names)
+		{
+			if (name != nullptr)
+				zend_string_release(name);
+		}
+	}
+}
+
 auto ClickHouseResult::fetch_assoc(zval *row) -> bool
 {
 	return this->fetch(row, FetchType::ASSOC);
@@ -43,54 +74,676 @@ auto ClickHouseResult::fetch_all(zval *rows, FetchType type) -> bool
 	return has_rows;
 }
 
+void ClickHouseResult::set_iterator_type(FetchType type)
+{
+	this->iterator_type = type;
+}
+
+auto ClickHouseResult::set_type_mapping(zend_long mapping) -> bool
+{
+	if (!check_type_mapping(mapping))
+		return false;
+
+	this->value_getter = get_value_getter(mapping);
+	return true;
+}
+
+auto ClickHouseResult::get_iterator_type() const -> FetchType
+{
+	return this->iterator_type;
+}
+
+auto ClickHouseResult::get_position() const -> size_t
+{
+	return this->position;
+}
+
 auto ClickHouseResult::fetch(zval *row, FetchType type) -> bool
 {
-	while (true)
+	Block *current = this->get_block();
+	if (current == nullptr)
+		return false;
+
+	// Receiving of the block is not conversion, the clock starts after it
+	size_t position = this->position;
+	uint64_t start = this->start_row_timer();
+
+	this->current_strings = this->get_strings();
+
+	this->prepare_numeric(*current);
+
+	if (!this->fill_row(row, *current, type))
+		return false;
+
+	this->next();
+
+	this->stop_row_timer(position, start);
+	return true;
+}
+
+auto ClickHouseResult::start_row_timer() const -> uint64_t
+{
+	if (this->position % CONVERSION_SAMPLE != 1 && this->position != 0)
+		return 0;
+
+	return ClickHouseStats::now();
+}
+
+void ClickHouseResult::stop_row_timer(size_t row, uint64_t start)
+{
+	if (start == 0)
 	{
-		if (this->blocks.empty())
-			return false;
+		clickhouse_stats_add(this->stats.get(), &ClickHouseStats::conversion_time, this->row_time);
+		return;
+	}
 
-		Block &block = this->blocks.front();
+	uint64_t duration = ClickHouseStats::now() - start;
+	clickhouse_stats_add(this->stats.get(), &ClickHouseStats::conversion_time, duration);
 
-		size_t columns = block.GetColumnCount();
-		size_t rows = block.GetRowCount();
+	// The first row also creates enum names and the properties map, it is not a sample for the rows after it
+	if (row != 0)
+		this->row_time = duration;
+}
+
+auto ClickHouseResult::fill_row(zval *row, const Block &block, FetchType type) const -> bool
+{
+	size_t columns = block.GetColumnCount();
 
-		array_init_size(row, type == FetchType::BOTH ? columns * 2 : columns);
+	array_init_size(row, type == FetchType::BOTH ? columns * 2 : columns);
 
-		for (size_t i = 0; i < columns; i++)
+	for (size_t i = 0; i < columns; i++)
+	{
+		switch (type)
 		{
-			switch (type)
+			case FetchType::ASSOC:
+				if (!this->add_type(row, block[i], i, block.GetColumnName(i)))
+					return false;
+				break;
+			case FetchType::NUM:
+				if (!this->add_type(row, block[i], i, ""))
+					return false;
+				break;
+			case FetchType::BOTH:
+				if (!this->add_type(row, block[i], i, ""))
+					return false;
+				if (!this->add_type(row, block[i], i, block.GetColumnName(i)))
+					return false;
+				break;
+		}
+	}
+
+	return true;
+}
+
+auto ClickHouseResult::fetch_many(zval *rows, size_t count, FetchType type) -> bool
+{
+	return this->fetch_rows(rows, count, type, false);
+}
+
+auto ClickHouseResult::fetch_block(zval *rows, FetchType type) -> bool
+{
+	return this->fetch_rows(rows, std::numeric_limits<size_t>::max(), type, true);
+}
+
+auto ClickHouseResult::fetch_rows(zval *rows, size_t count, FetchType type, bool single_block) -> bool
+{
+	ClickHouseTimer timer(this->stats.get(), &ClickHouseStats::conversion_time);
+
+	Block *current = this->get_block();
+	if (current == nullptr)
+		return false;
+
+	// Rows of the current block are always there, buffered result also knows how many rows are left
+	size_t available = current->GetRowCount() - this->next_row;
+	if (!single_block && !this->pipeline)
+		available = std::max(available, this->rows_count - this->position);
+
+	array_init_size(rows, static_cast<uint32_t>(std::min({count, available, static_cast<size_t>(HT_MAX_SIZE)})));
+	zend_hash_real_init(Z_ARRVAL_P(rows), 1);
+
+	while (count != 0 && current != nullptr)
+	{
+		// Block is released by next() after its last row, so the number of rows is taken beforehand
+		size_t block_rows = std::min(current->GetRowCount() - this->next_row, count);
+
+		this->current_strings = this->get_strings();
+
+		this->convert_numeric(*current, block_rows);
+
+		for (size_t i = 0; i < block_rows; i++)
+		{
+			zval row;
+			if (!this->fill_row(&row, *current, type))
 			{
-				case FetchType::ASSOC:
-					if (!this->add_type(row, block[i], block.GetColumnName(i)))
-						return false;
-					break;
-				case FetchType::NUM:
-					if (!this->add_type(row, block[i], ""))
-						return false;
-					break;
-				case FetchType::BOTH:
-					if (!this->add_type(row, block[i], ""))
-						return false;
-					if (!this->add_type(row, block[i], block.GetColumnName(i)))
-						return false;
-					break;
+				zval_ptr_dtor(&row);
+				zval_ptr_dtor(rows);
+				ZVAL_UNDEF(rows);
+				return false;
 			}
+
+			zend_hash_next_index_insert_new(Z_ARRVAL_P(rows), &row);
+			this->next();
+		}
+
+		count -= block_rows;
+
+		if (single_block)
+			break;
+
+		current = count != 0 ? this->get_block() : nullptr;
+	}
+
+	CLICKHOUSE_PROBE(fetch__batch, zend_hash_num_elements(Z_ARRVAL_P(rows)));
+
+	return true;
+}
+
+void ClickHouseResult::prepare_numeric(const Block &block)
+{
+	if (this->next_row - this->numeric_first_row < this->numeric_rows)
+		return;
+
+	this->convert_numeric(block, std::min(block.GetRowCount() - this->next_row, NUMERIC_CHUNK));
+}
+
+void ClickHouseResult::convert_numeric(const Block &block, size_t count)
+{
+	this->numeric_columns.clear();
+	this->numeric_first_row = this->next_row;
+	this->numeric_rows = count;
+
+	size_t columns = block.GetColumnCount();
+
+	// Only types converted the same way with any type mapping, all their values fit zend_long or double
+	auto get_numeric_code = [] (const ColumnRef &column) -> Type::Code
+	{
+		Type::Code code = column->Type()->GetCode();
+		if (code == Type::Code::Nullable)
+			code = column->As<ColumnNullable>()->Nested()->Type()->GetCode();
+
+		switch (code)
+		{
+			case Type::Code::Int8:
+			case Type::Code::Int16:
+			case Type::Code::Int32:
+			case Type::Code::UInt8:
+			case Type::Code::UInt16:
+			case Type::Code::Float32:
+			case Type::Code::Float64:
+				return code;
+			case Type::Code::Int64:
+			case Type::Code::UInt32:
+				return sizeof(zend_long) == sizeof(int64_t) ? code : Type::Code::Void;
+			default:
+				return Type::Code::Void;
+		}
+	};
+
+	size_t converted = 0;
+	for (size_t i = 0; i < columns; i++)
+		converted += get_numeric_code(block[i]) != Type::Code::Void ? 1 : 0;
+
+	// Single rows gain nothing from column-wide loops
+	if (converted == 0 || count < 2)
+		return;
+
+	this->numeric_values.resize(converted * count);
+	this->numeric_columns.assign(columns, nullptr);
+
+	zval *values = this->numeric_values.data();
+	size_t row = this->next_row;
+
+	for (size_t i = 0; i < columns; i++)
+	{
+		ColumnRef column = block[i];
+
+		Type::Code type_code = get_numeric_code(column);
+		if (type_code == Type::Code::Void)
+			continue;
+
+		const uint8_t *nulls = nullptr;
+		if (column->Type()->GetCode() == Type::Code::Nullable)
+		{
+			auto nullable = column->As<ColumnNullable>();
+
+			nulls = &nullable->Nulls()->As<ColumnUInt8>()->At(row);
+			column = nullable->Nested();
+		}
+
+		switch (type_code)
+		{
+			case Type::Code::Int8:
+				convert_longs(&column->As<ColumnInt8>()->At(row), count, values);
+				break;
+			case Type::Code::Int16:
+				convert_longs(&column->As<ColumnInt16>()->At(row), count, values);
+				break;
+			case Type::Code::Int32:
+				convert_longs(&column->As<ColumnInt32>()->At(row), count, values);
+				break;
+			case Type::Code::Int64:
+				convert_longs(&column->As<ColumnInt64>()->At(row), count, values);
+				break;
+			case Type::Code::UInt8:
+				convert_longs(&column->As<ColumnUInt8>()->At(row), count, values);
+				break;
+			case Type::Code::UInt16:
+				convert_longs(&column->As<ColumnUInt16>()->At(row), count, values);
+				break;
+			case Type::Code::UInt32:
+				convert_longs(&column->As<ColumnUInt32>()->At(row), count, values);
+				break;
+			case Type::Code::Float32:
+				convert_doubles(&column->As<ColumnFloat32>()->At(row), count, values);
+				break;
+			case Type::Code::Float64:
+				convert_doubles(&column->As<ColumnFloat64>()->At(row), count, values);
+				break;
+			default:
+				break;
+		}
+
+		if (nulls != nullptr)
+			convert_nulls(nulls, count, values);
+
+		this->numeric_columns[i] = values;
+		values += count;
+	}
+}
+
+void ClickHouseResult::reset_numeric()
+{
+	this->numeric_columns.clear();
+	this->numeric_rows = 0;
+}
+
+auto ClickHouseResult::fetch_object(zval *object, zend_class_entry *ce, HashTable *ctor_args) -> bool
+{
+	if (!this->fetch_object_row(object, ce))
+		return false;
+
+	if (call_constructor(object, ce, ctor_args))
+		return true;
+
+	zval_ptr_dtor(object);
+	ZVAL_UNDEF(object);
+	return false;
+}
+
+auto ClickHouseResult::fetch_all_objects(zval *objects, zend_class_entry *ce, HashTable *ctor_args) -> bool
+{
+	bool has_rows = false;
+	while (true)
+	{
+		zval object;
+
+		if (!this->fetch_object(&object, ce, ctor_args))
+			break;
+
+		if (!has_rows)
+		{
+			has_rows = true;
+			array_init(objects);
+		}
+
+		add_next_index_zval(objects, &object);
+	}
+
+	return has_rows;
+}
+
+auto ClickHouseResult::fetch_object_row(zval *object, zend_class_entry *ce) -> bool
+{
+	Block *current = this->get_block();
+	if (current == nullptr)
+		return false;
+
+	Block &block = *current;
+
+	size_t columns = block.GetColumnCount();
+
+	size_t position = this->position;
+	uint64_t start = this->start_row_timer();
+
+	this->map_properties(block, ce);
+
+	this->current_strings = this->get_strings();
+
+	this->prepare_numeric(block);
+
+	if (object_init_ex(object, ce) == FAILURE)
+		return false;
+
+	zend_object *obj = Z_OBJ_P(object);
+
+	for (size_t i = 0; i < columns; i++)
+	{
+		zval value;
+
+		if (!this->get_value(&value, block[i], i))
+		{
+			zval_ptr_dtor(object);
+			ZVAL_UNDEF(object);
+			return false;
+		}
+
+		zend_property_info *property = this->properties[i];
+		if (property == nullptr)
+		{
+#if PHP_API_VERSION >= 20200930
+			zend_update_property_ex(ce, obj, this->properties_names[i], &value);
+#else
+			zend_update_property_ex(ce, object, this->properties_names[i], &value);
+#endif
+			zval_ptr_dtor(&value);
+			continue;
+		}
+
+#if PHP_API_VERSION >= 20190902
+		// Typed property must get a value of its type, non-strict coercion like for regular assignment
+		if (ZEND_TYPE_IS_SET(property->type) && !zend_verify_property_type(property, &value, 0))
+		{
+			zval_ptr_dtor(&value);
+			zval_ptr_dtor(object);
+			ZVAL_UNDEF(object);
+			return false;
+		}
+#endif
+
+		zval *slot = OBJ_PROP(obj, property->offset);
+
+		zval_ptr_dtor(slot);
+		ZVAL_COPY_VALUE(slot, &value);
+	}
+
+	this->next();
+
+	this->stop_row_timer(position, start);
+	return true;
+}
+
+auto ClickHouseResult::data_seek(size_t offset) -> bool
+{
+	if (!this->seekable)
+	{
+		zend_error(E_WARNING, "Result is not seekable, use CLICKHOUSE_SEEKABLE_RESULT mode for query");
+		return false;
+	}
+
+	if (offset >= this->rows_count)
+		return false;
+
+	// Last block starting at or before the offset
+	auto iter = std::upper_bound(this->offsets.begin(), this->offsets.end(), offset) - 1;
+
+	this->current_block = static_cast<size_t>(iter - this->offsets.begin());
+	this->next_row = offset - *iter;
+	this->position = offset;
+
+	this->reset_numeric();
+
+	return true;
+}
+
+auto ClickHouseResult::fetch_row_at(zval *row, size_t offset, FetchType type) -> bool
+{
+	if (!this->data_seek(offset))
+		return false;
+
+	return this->fetch(row, type);
+}
+
+auto ClickHouseResult::is_seekable() const -> bool
+{
+	return this->seekable;
+}
+
+auto ClickHouseResult::get_block() -> Block*
+{
+	if (this->current_block >= this->blocks.size() && !this->receive_block())
+		return nullptr;
+
+	return &this->blocks[this->current_block];
+}
+
+auto ClickHouseResult::get_strings() const -> const BlockStrings*
+{
+	if (this->current_block >= this->strings.size())
+		return nullptr;
+
+	return &this->strings[this->current_block];
+}
+
+auto ClickHouseResult::receive_block() -> bool
+{
+	if (this->store)
+	{
+		Block block;
+		if (!this->store->pop(block))
+		{
+			this->store.reset();
+			return false;
 		}
 
-		this->next_row++;
+		if (this->direct_strings)
+			this->strings.push_back(decode_strings(block));
+
+		this->blocks.push_back(std::move(block));
+		return true;
+	}
+
+	if (!this->pipeline)
+		return false;
+
+	Block block;
+	if (!this->pipeline->pop(block))
+	{
+		int32_t code;
+		string message;
+
+		bool failed = this->pipeline->get_error(code, message);
+		if (failed)
+		{
+			zend_error(E_WARNING, "Failed to receive query result: %s (%d)", message.c_str(), code);
+			clickhouse_stats_add(this->stats.get(), &ClickHouseStats::errors, 1);
+		}
+
+		uint64_t bytes_received = this->pipeline->get_bytes_received();
+		clickhouse_stats_add(this->stats.get(), &ClickHouseStats::bytes_received, bytes_received);
+		this->pipeline->add_thread_stats(this->stats.get());
+
+		CLICKHOUSE_PROBE(query__done, this->rows_count, bytes_received, failed);
+
+		// Connection is released, all rows are known now
+		this->pipeline.reset();
+		this->set_num_rows(static_cast<zend_long>(this->rows_count));
+		return false;
+	}
+
+	clickhouse_stats_add(this->stats.get(), &ClickHouseStats::rows_received, block.GetRowCount());
+	clickhouse_stats_add(this->stats.get(), &ClickHouseStats::blocks_received, 1);
+
+	this->rows_count += block.GetRowCount();
+
+	if (this->direct_strings)
+		this->strings.push_back(decode_strings(block));
+
+	this->blocks.push_back(std::move(block));
+	return true;
+}
+
+void ClickHouseResult::next()
+{
+	this->next_row++;
+	this->position++;
+
+	if (this->blocks[this->current_block].GetRowCount() != this->next_row)
+		return;
+
+	this->next_row = 0;
+
+	this->reset_numeric();
+
+	if (this->seekable)
+	{
+		this->current_block++;
+		return;
+	}
+
+	this->blocks.pop_front();
+
+	if (!this->strings.empty())
+	{
+		release_strings(this->strings.front());
+		this->strings.pop_front();
+	}
+}
+
+void ClickHouseResult::map_properties(const Block &block, zend_class_entry *ce)
+{
+	size_t columns = block.GetColumnCount();
+
+	// All blocks of the result have the same columns, mapping depends only on the class
+	if (this->properties_class == ce && this->properties.size() == columns)
+		return;
+
+	this->release_properties();
+
+	this->properties_class = ce;
+	this->properties.reserve(columns);
+	this->properties_names.reserve(columns);
+
+	for (size_t i = 0; i < columns; i++)
+	{
+		const string &name = block.GetColumnName(i);
+
+		zend_string *property_name = zend_string_init(name.data(), name.length(), 0);
+
+		auto property = static_cast<zend_property_info*>(zend_hash_find_ptr(&ce->properties_info, property_name));
+		if (property != nullptr && (property->flags & ZEND_ACC_STATIC) != 0)
+			property = nullptr;
+
+#if PHP_API_VERSION >= 20240924
+		// Hooked and virtual properties have no plain slot to write into
+		if (property != nullptr && property->hooks != nullptr)
+			property = nullptr;
+#endif
+
+		this->properties.push_back(property);
+		this->properties_names.push_back(property_name);
+	}
+}
+
+void ClickHouseResult::release_properties()
+{
+	for (zend_string *name : this->properties_names)
+		zend_string_release(name);
+
+	this->properties_class = nullptr;
+	this->properties.clear();
+	this->properties_names.clear();
+}
 
-		if (rows == this->next_row)
+auto ClickHouseResult::call_constructor(zval *object, zend_class_entry *ce, HashTable *ctor_args) -> bool
+{
+	if (ce->constructor == nullptr)
+	{
+		if (ctor_args != nullptr && zend_hash_num_elements(ctor_args) != 0)
 		{
-			this->blocks.pop_front();
-			this->next_row = 0;
+			zend_error(E_WARNING, "Class %s does not have a constructor, constructor arguments must be empty", ZSTR_VAL(ce->name));
+			return false;
 		}
 
 		return true;
 	}
+
+	zval retval;
+
+	zend_fcall_info fci;
+	zend_fcall_info_cache fcc;
+
+	fci.size = sizeof(fci);
+	ZVAL_UNDEF(&fci.function_name);
+	fci.object = Z_OBJ_P(object);
+	fci.retval = &retval;
+	fci.params = nullptr;
+	fci.param_count = 0;
+
+#if PHP_API_VERSION >= 20200930
+	fci.named_params = ctor_args;
+#else
+	fci.no_separation = 1;
+
+	if (ctor_args != nullptr)
+	{
+		zval args;
+		ZVAL_ARR(&args, ctor_args);
+
+		if (zend_fcall_info_args(&fci, &args) == FAILURE)
+			return false;
+	}
+#endif
+
+	fcc.function_handler = ce->constructor;
+	fcc.called_scope = Z_OBJCE_P(object);
+	fcc.object = Z_OBJ_P(object);
+
+	// ReSharper disable once CppTooWideScopeInitStatement
+	auto result = zend_call_function(&fci, &fcc);
+
+#if PHP_API_VERSION < 20200930
+	zend_fcall_info_args_clear(&fci, 1);
+#endif
+
+	if (result == FAILURE)
+	{
+		zend_error(E_WARNING, "Failed to call constructor %s::%s()", ZSTR_VAL(ce->name), ZSTR_VAL(ce->constructor->common.function_name));
+		return false;
+	}
+
+	zval_ptr_dtor(&retval);
+
+	return EG(exception) == nullptr;
+}
+
+auto ClickHouseResult::add_type(zval *row, const ColumnRef &column, size_t index, const string &name) const -> bool
+{
+	zval value;
+
+	if (!this->get_value(&value, column, index))
+		return false;
+
+	if (!name.empty())
+		add_assoc_zval_ex(row, name.c_str(), name.length(), &value);
+	else
+		add_next_index_zval(row, &value);
+
+	return true;
+}
+
+auto ClickHouseResult::get_value(zval *value, const ColumnRef &column, size_t index) const -> bool
+{
+	if (index < this->numeric_columns.size() && this->numeric_columns[index] != nullptr && this->next_row - this->numeric_first_row < this->numeric_rows)
+	{
+		ZVAL_COPY_VALUE(value, &this->numeric_columns[index][this->next_row - this->numeric_first_row]);
+		return true;
+	}
+
+	return (this->*this->value_getter)(value, column, index);
 }
 
-auto ClickHouseResult::add_type(zval *row, const ColumnRef &column, const string &name) const -> bool
+auto ClickHouseResult::get_value_getter(zend_long mapping) -> ValueGetter
+{
+	static constexpr auto getters = [] <size_t... I> (std::index_sequence<I...>)
+	{
+		return std::array<ValueGetter, sizeof...(I)>{&ClickHouseResult::get_mapped_value<static_cast<zend_long>(I) << MAPPING_SHIFT>...};
+	}(std::make_index_sequence<(MAPPING_MASK >> MAPPING_SHIFT) + 1>{});
+
+	return getters[static_cast<size_t>((mapping & MAPPING_MASK) >> MAPPING_SHIFT)];
+}
+
+template<zend_long Mapping>
+auto ClickHouseResult::get_mapped_value(zval *value, const ColumnRef &column, size_t index) const -> bool
 {
 	// ReSharper disable once CppTooWideScope
 	Type::Code type_code = column->Type()->GetCode();
@@ -99,76 +752,99 @@ auto ClickHouseResult::add_type(zval *row, const ColumnRef &column, const string
 	{
 //		case Type::Code::Void:
 		case Type::Code::Int8:
-			this->add_long<ColumnInt8>(row, column, name);
+			this->set_long<Mapping, ColumnInt8>(value, column);
 			break;
 		case Type::Code::Int16:
-			this->add_long<ColumnInt16>(row, column, name);
+			this->set_long<Mapping, ColumnInt16>(value, column);
 			break;
 		case Type::Code::Int32:
-			this->add_long<ColumnInt32>(row, column, name);
+			this->set_long<Mapping, ColumnInt32>(value, column);
 			break;
 		case Type::Code::Int64:
-			this->add_long<ColumnInt64>(row, column, name);
+			this->set_long<Mapping, ColumnInt64>(value, column);
 			break;
 		case Type::Code::UInt8:
-			this->add_long<ColumnUInt8>(row, column, name);
+			this->set_long<Mapping, ColumnUInt8>(value, column);
 			break;
 		case Type::Code::UInt16:
-			this->add_long<ColumnUInt16>(row, column, name);
+			this->set_long<Mapping, ColumnUInt16>(value, column);
 			break;
 		case Type::Code::UInt32:
-			this->add_long<ColumnUInt32>(row, column, name);
+			this->set_long<Mapping, ColumnUInt32>(value, column);
 			break;
 		case Type::Code::UInt64:
-			this->add_long<ColumnUInt64>(row, column, name);
+			this->set_long<Mapping, ColumnUInt64>(value, column);
 			break;
 		case Type::Code::Float32:
-			this->add_float<ColumnFloat32>(row, column, name);
+			this->set_float<ColumnFloat32>(value, column);
 			break;
 		case Type::Code::Float64:
-			this->add_float<ColumnFloat64>(row, column, name);
+			this->set_float<ColumnFloat64>(value, column);
 			break;
 		case Type::Code::String:
-			this->add_string<ColumnString>(row, column, name);
+			if (this->current_strings != nullptr && !(*this->current_strings)[index].empty())
+			{
+				ZVAL_STR_COPY(value, (*this->current_strings)[index][this->next_row]);
+				break;
+			}
+
+			this->set_string<ColumnString>(value, column);
 			break;
 		case Type::Code::FixedString:
-			this->add_string<ColumnFixedString>(row, column, name);
+			this->set_string<ColumnFixedString>(value, column);
 			break;
 		case Type::Code::DateTime:
-			this->add_date<ColumnDateTime>(row, column, name);
+			this->set_date<Mapping, ColumnDateTime>(value, column);
 			break;
 		case Type::Code::DateTime64:
-			this->add_date<ColumnDateTime64>(row, column, name);
+			this->set_date<Mapping, ColumnDateTime64>(value, column);
 			break;
 		case Type::Code::Date:
-			this->add_date<ColumnDate>(row, column, name);
+			this->set_date<Mapping, ColumnDate>(value, column);
 			break;
 		case Type::Code::Date32:
-			this->add_date<ColumnDate32>(row, column, name);
+			this->set_date<Mapping, ColumnDate32>(value, column);
 			break;
 //		case Type::Code::Array:
 		case Type::Code::Nullable:
-			return this->add_null(row, column, name);
+		{
+			auto nullable = column->As<ColumnNullable>();
+
+			if (nullable->IsNull(this->next_row))
+			{
+				ZVAL_NULL(value);
+				break;
+			}
+
+			return this->get_mapped_value<Mapping>(value, nullable->Nested(), index);
+		}
 //		case Type::Code::Tuple:
-//		case Type::Code::Enum8:
-//		case Type::Code::Enum16:
+		case Type::Code::Enum8:
+			this->set_enum<ColumnEnum8>(value, column, index);
+			break;
+		case Type::Code::Enum16:
+			this->set_enum<ColumnEnum16>(value, column, index);
+			break;
 		case Type::Code::UUID:
-			this->add_string<ColumnUUID>(row, column, name);
+			this->set_string<ColumnUUID>(value, column);
 			break;
 		case Type::Code::IPv4:
-			this->add_string<ColumnIPv4>(row, column, name);
+			if constexpr ((Mapping & IPV4_AS_INT) != 0)
+				ZVAL_LONG(value, static_cast<zend_long>(ntohl(column->As<ColumnIPv4>()->At(this->next_row).s_addr)));
+			else
+				this->set_string<ColumnIPv4>(value, column);
 			break;
 		case Type::Code::IPv6:
-			this->add_string<ColumnIPv6>(row, column, name);
+			this->set_string<ColumnIPv6>(value, column);
 			break;
 		case Type::Code::Int128:
-			this->add_long<ColumnInt128>(row, column, name);
+			this->set_long<Mapping, ColumnInt128>(value, column);
 			break;
 		case Type::Code::Decimal:
 		case Type::Code::Decimal32:
 		case Type::Code::Decimal64:
 		case Type::Code::Decimal128:
-			this->add_decimal(row, column, name);
+			this->set_decimal<Mapping>(value, column);
 			break;
 		case Type::Code::LowCardinality:
 		{
@@ -180,7 +856,7 @@ auto ClickHouseResult::add_type(zval *row, const ColumnRef &column, const string
 			switch (nested_code)
 			{
 				case Type::Code::String:
-					this->add_string<ColumnLowCardinalityT<ColumnString>>(row, column, name);
+					this->set_string<ColumnLowCardinalityT<ColumnString>>(value, column);
 					break;
 				default:
 					zend_error(E_WARNING, "Type LowCardinality(%s) (%d) is unsupported", nested_type->GetName().c_str(), nested_code);
@@ -196,41 +872,73 @@ auto ClickHouseResult::add_type(zval *row, const ColumnRef &column, const string
 	return true;
 }
 
-auto ClickHouseResult::add_null(zval *row, const ColumnRef &column, const string &name) const -> bool
+auto ClickHouseResult::get_enum_names(const ColumnRef &column, size_t index) const -> const EnumNames&
 {
-	auto value = column->As<ColumnNullable>();
+	if (this->enum_names.size() <= index)
+		this->enum_names.resize(index + 1);
 
-	if (value->IsNull(this->next_row))
-	{
-		if (!name.empty())
-			add_assoc_null_ex(row, name.c_str(), name.length());
-		else
-			add_next_index_null(row);
-		return true;
-	}
+	EnumNames &column_names = this->enum_names[index];
+	if (!column_names.names.empty())
+		return column_names;
+
+	// Values of the type are sorted, so names are stored in a dense array from the smallest code
+	auto enum_type = column->Type()->As<EnumType>();
+	auto first = enum_type->BeginValueToName();
+	auto last = std::prev(enum_type->EndValueToName());
+
+	column_names.min_value = first->first;
+	column_names.names.resize(static_cast<size_t>(last->first - first->first) + 1, nullptr);
 
-	return this->add_type(row, value->Nested(), name);
+	for (auto iter = first; iter != enum_type->EndValueToName(); ++iter)
+		column_names.names[static_cast<size_t>(iter->first - first->first)] = zend_string_init(iter->second.data(), iter->second.length(), false);
+
+	return column_names;
 }
 
-void ClickHouseResult::add_decimal(zval *row, const ColumnRef &column, const string &name) const
+auto ClickHouseResult::decode_strings(const Block &block) -> BlockStrings
 {
-	auto decimal_column = column->As<ColumnDecimal>();
+	size_t columns = block.GetColumnCount();
+	size_t rows = block.GetRowCount();
 
-	string text_value = std::to_string(decimal_column->At(this->next_row));
+	BlockStrings block_strings(columns);
 
-	auto type_decimal = reinterpret_cast<DecimalType*>(decimal_column->Type().get());
+	for (size_t i = 0; i < columns; i++)
+	{
+		ColumnRef column = block[i];
+		if (column->Type()->GetCode() == Type::Code::Nullable)
+			column = column->As<ColumnNullable>()->Nested();
 
-	// ReSharper disable once CppTooWideScopeInitStatement
-	size_t scale = type_decimal->GetScale();
-	if (scale != 0)
-		text_value.insert(text_value.length() - scale, ".");
+		if (column->Type()->GetCode() != Type::Code::String)
+			continue;
 
-	if (!name.empty())
-		add_assoc_stringl_ex(row, name.c_str(), name.length(), text_value.data(), text_value.length());
-	else
-		add_next_index_stringl(row, text_value.data(), text_value.length());
+		auto string_column = column->As<ColumnString>();
+
+		StringColumn &values = block_strings[i];
+		values.reserve(rows);
+
+		for (size_t row = 0; row < rows; row++)
+		{
+			string_view value = string_column->At(row);
 
-//	php_printf("value = %lu, scale = %ld, text_value = '%s', text_value length = %lu\n", static_cast<uint64_t>(value), scale, text_value.c_str(), text_value.length());
+			values.push_back(value.empty() ? ZSTR_EMPTY_ALLOC() : zend_string_init(value.data(), value.length(), 0));
+		}
+
+		// Wire data is not needed anymore, only PHP strings are kept
+		string_column->Clear();
+	}
+
+	return block_strings;
+}
+
+void ClickHouseResult::release_strings(BlockStrings &block_strings)
+{
+	for (StringColumn &values : block_strings)
+	{
+		for (zend_string *value : values)
+			zend_string_release(value);
+	}
+
+	block_strings.clear();
 }
 
 auto ClickHouseResult::get_fetch_type(zend_long resulttype) -> FetchType
@@ -250,6 +958,15 @@ auto ClickHouseResult::get_fetch_type(zend_long resulttype) -> FetchType
 	return FetchType::BOTH;
 }
 
+auto ClickHouseResult::check_type_mapping(zend_long mapping) -> bool
+{
+	if ((mapping & ~MAPPING_MASK) == 0)
+		return true;
+
+	zend_error(E_WARNING, "Unknown type mapping flags %ld", mapping & ~MAPPING_MASK);
+	return false;
+}
+
 void ClickHouseResult::set_num_rows(zend_long value) const
 {
 #if PHP_API_VERSION >= 20200930
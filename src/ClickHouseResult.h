@@ -1,6 +1,8 @@
 #pragma once
 
 #include "util.h"
+#include "ClickHousePipeline.h"
+#include "ClickHouseBlockStore.h"
 
 #include <netinet/in.h>
 
@@ -16,48 +18,176 @@ public:
 		BOTH = 3
 	};
 
+	enum ResultMode : zend_long
+	{
+		STORE_RESULT = 0,
+		// Same value as MYSQLI_USE_RESULT
+		USE_RESULT = 1 << 0,
+		SEEKABLE_RESULT = 1 << 1,
+		DIRECT_STRINGS = 1 << 2,
+		COMPRESSED_RESULT = 1 << 3,
+
+		// Type mapping flags, also can be set as defaults of the connection or changed for the result
+		DATES_AS_TIMESTAMPS = 1 << 8,
+		BIG_INTEGERS_AS_FLOAT = 1 << 9,
+		DECIMALS_AS_FLOAT = 1 << 10,
+		IPV4_AS_INT = 1 << 11
+	};
+
+	static constexpr zend_long MAPPING_SHIFT = 8;
+	static constexpr zend_long MAPPING_MASK = 0xF << MAPPING_SHIFT;
+
+	// Decoded values of String columns for each column of a block, empty for other columns
+	using StringColumn = vector<zend_string*, ZendAllocator<zend_string*>>;
+	using BlockStrings = vector<StringColumn>;
+
 private:
 	static constexpr int64_t PHP_INT_MAX = 9223372036854775807L;
 	static constexpr int64_t PHP_INT_MIN = ~PHP_INT_MAX;
 
+	// Rows fetched one by one read the clock for one row of each sample, the others count the time of that row
+	static constexpr size_t CONVERSION_SAMPLE = 64;
+
 	zend_object *zend_this;
 
 	deque<Block> blocks;
 
+	// With DIRECT_STRINGS mode String columns are converted to PHP strings once when block is received, fetch only adds references
+	deque<BlockStrings> strings;
+	const BlockStrings *current_strings;
+	bool direct_strings;
+
+	// With USE_RESULT mode blocks are received by pipeline thread while PHP reads previous ones
+	shared_ptr<ClickHousePipeline> pipeline;
+
+	// Blocks received after the spill threshold, they go after the blocks in memory
+	std::unique_ptr<ClickHouseBlockStore> store;
+
+	// Seekable result keeps all blocks, offsets contains the number of the first row for each block
+	bool seekable;
+	vector<size_t, ZendAllocator<size_t>> offsets;
+	size_t current_block;
+
+	size_t rows_count;
 	size_t next_row;
+	size_t position;
 	long int timezone_offset;
 
+	FetchType iterator_type;
+
+	uint64_t row_time;
+
+	// Numeric columns are converted column by column for the rows of fetch_many() and fetch_block() or for a chunk of rows
+	// fetched one by one, numeric_columns points to the value of numeric_first_row for each column or is nullptr if the column
+	// is not converted
+	static constexpr size_t NUMERIC_CHUNK = 1024;
+	vector<zval, ZendAllocator<zval>> numeric_values;
+	vector<const zval*, ZendAllocator<const zval*>> numeric_columns;
+	size_t numeric_first_row;
+	size_t numeric_rows;
+
+	// Names of Enum values for each column, created once from the type and shared by all fetched rows
+	struct EnumNames
+	{
+		int16_t min_value;
+		vector<zend_string*, ZendAllocator<zend_string*>> names;
+	};
+	mutable vector<EnumNames, ZendAllocator<EnumNames>> enum_names;
+
+	// Converters of each mapping are separate instantiations, the one for the result is chosen once instead of checking flags for each value
+	using ValueGetter = bool (ClickHouseResult::*)(zval *value, const ColumnRef &column, size_t index) const;
+	ValueGetter value_getter;
+
+	// Statistics of the connection, it can be closed before the result is released
+	shared_ptr<ClickHouseStats> stats;
+
+	zend_class_entry *properties_class;
+	vector<zend_property_info*, ZendAllocator<zend_property_info*>> properties;
+	vector<zend_string*, ZendAllocator<zend_string*>> properties_names;
+
 	[[nodiscard]] auto fetch(zval *row, FetchType type) -> bool;
+	[[nodiscard]] auto fill_row(zval *row, const Block &block, FetchType type) const -> bool;
+	[[nodiscard]] auto fetch_rows(zval *rows, size_t count, FetchType type, bool single_block) -> bool;
+	[[nodiscard]] auto fetch_object_row(zval *object, zend_class_entry *ce) -> bool;
 
-	[[nodiscard]] auto add_type(zval *row, const ColumnRef &column, const string &name) const -> bool;
+	void prepare_numeric(const Block &block);
+	void convert_numeric(const Block &block, size_t count);
+	void reset_numeric();
 
-	template<class T>
-	void add_long(zval *row, const ColumnRef &column, const string &name) const;
+	[[nodiscard]] auto start_row_timer() const -> uint64_t;
+	void stop_row_timer(size_t row, uint64_t start);
+
+	[[nodiscard]] auto get_block() -> Block*;
+	[[nodiscard]] auto get_strings() const -> const BlockStrings*;
+	[[nodiscard]] auto receive_block() -> bool;
+
+	void next();
+
+	[[nodiscard]] auto add_type(zval *row, const ColumnRef &column, size_t index, const string &name) const -> bool;
+	[[nodiscard]] auto get_value(zval *value, const ColumnRef &column, size_t index) const -> bool;
+
+	template<zend_long Mapping>
+	[[nodiscard]] auto get_mapped_value(zval *value, const ColumnRef &column, size_t index) const -> bool;
+
+	template<zend_long Mapping, class T>
+	void set_long(zval *value, const ColumnRef &column) const;
 
 	template<class T>
-	void add_float(zval *row, const ColumnRef &column, const string &name) const;
+	void set_float(zval *value, const ColumnRef &column) const;
 
 	template<class T>
-	void add_string(zval *row, const ColumnRef &column, const string &name) const;
+	void set_string(zval *value, const ColumnRef &column) const;
+
+	template<zend_long Mapping, class T>
+	void set_date(zval *value, const ColumnRef &column) const;
+
+	template<zend_long Mapping>
+	void set_decimal(zval *value, const ColumnRef &column) const;
 
 	template<class T>
-	void add_date(zval *row, const ColumnRef &column, const string &name) const;
+	void set_enum(zval *value, const ColumnRef &column, size_t index) const;
+
+	[[nodiscard]] auto get_enum_names(const ColumnRef &column, size_t index) const -> const EnumNames&;
 
-	[[nodiscard]] auto add_null(zval *row, const ColumnRef &column, const string &name) const -> bool;
+	[[nodiscard]] static auto get_value_getter(zend_long mapping) -> ValueGetter;
 
-	void add_decimal(zval *row, const ColumnRef &column, const string &name) const;
+	void map_properties(const Block &block, zend_class_entry *ce);
+	void release_properties();
 
 	void set_num_rows(zend_long value) const;
 
+	[[nodiscard]] static auto call_constructor(zval *object, zend_class_entry *ce, HashTable *ctor_args) -> bool;
+
+	static void release_strings(BlockStrings &block_strings);
+
 public:
-	ClickHouseResult(zend_object *zend_this, deque<Block> blocks, size_t rows_count, long int timezone_offset);
+	ClickHouseResult(zend_object *zend_this, deque<Block> blocks, deque<BlockStrings> strings, size_t rows_count, long int timezone_offset, zend_long resultmode, shared_ptr<ClickHouseStats> stats, shared_ptr<ClickHousePipeline> pipeline, std::unique_ptr<ClickHouseBlockStore> store);
+	~ClickHouseResult();
 
 	[[nodiscard]] auto fetch_assoc(zval *row) -> bool;
 	[[nodiscard]] auto fetch_row(zval *row) -> bool;
 	[[nodiscard]] auto fetch_array(zval *row, FetchType type) -> bool;
 	[[nodiscard]] auto fetch_all(zval *rows, FetchType type) -> bool;
+	[[nodiscard]] auto fetch_many(zval *rows, size_t count, FetchType type) -> bool;
+	[[nodiscard]] auto fetch_block(zval *rows, FetchType type) -> bool;
+	[[nodiscard]] auto fetch_object(zval *object, zend_class_entry *ce, HashTable *ctor_args) -> bool;
+	[[nodiscard]] auto fetch_all_objects(zval *objects, zend_class_entry *ce, HashTable *ctor_args) -> bool;
+
+	[[nodiscard]] auto data_seek(size_t offset) -> bool;
+	[[nodiscard]] auto fetch_row_at(zval *row, size_t offset, FetchType type) -> bool;
+
+	[[nodiscard]] auto is_seekable() const -> bool;
+
+	void set_iterator_type(FetchType type);
+	[[nodiscard]] auto set_type_mapping(zend_long mapping) -> bool;
+	[[nodiscard]] auto get_iterator_type() const -> FetchType;
+
+	[[nodiscard]] auto get_position() const -> size_t;
 
 	[[nodiscard]] static auto get_fetch_type(zend_long resulttype) -> FetchType;
+	[[nodiscard]] static auto check_type_mapping(zend_long mapping) -> bool;
+
+	[[nodiscard]] static auto decode_strings(const Block &block) -> BlockStrings;
 };
 
 struct ClickHouseResultObject
@@ -66,83 +196,124 @@ struct ClickHouseResultObject
 	zend_object std;
 };
 
-template<class T>
-void ClickHouseResult::add_long(zval *row, const ColumnRef &column, const string &name) const
+inline auto clickhouse_result_new(deque<Block> blocks, deque<ClickHouseResult::BlockStrings> strings, size_t rows_count, long int timezone_offset, zend_long resultmode, shared_ptr<ClickHouseStats> stats, shared_ptr<ClickHousePipeline> pipeline = nullptr, std::unique_ptr<ClickHouseBlockStore> store = nullptr) -> zend_object*
+{
+	auto obj = static_cast<ClickHouseResultObject*>(zend_object_alloc(sizeof(ClickHouseResultObject), clickhouse_result_class_entry));
+
+	zend_object_std_init(&obj->std, clickhouse_result_class_entry);
+	object_properties_init(&obj->std, clickhouse_result_class_entry);
+
+	obj->std.handlers = &clickhouse_object_result_handlers;
+
+	obj->impl = new ClickHouseResult(&obj->std, std::move(blocks), std::move(strings), rows_count, timezone_offset, resultmode, std::move(stats), std::move(pipeline), std::move(store));
+
+	return &obj->std;
+}
+
+template<zend_long Mapping, class T>
+void ClickHouseResult::set_long(zval *value, const ColumnRef &column) const
 {
-	auto value = column->As<T>()->At(this->next_row);
+	auto result = column->As<T>()->At(this->next_row);
 
 #pragma GCC diagnostic push
 #pragma GCC diagnostic ignored "-Wsign-compare"
-	if (value > PHP_INT_MAX || (!std::is_unsigned_v<decltype(value)> && value < PHP_INT_MIN))
+	if (result > PHP_INT_MAX || (!std::is_unsigned_v<decltype(result)> && result < PHP_INT_MIN))
 	{
-		string value_string = std::to_string(value);
+		if constexpr ((Mapping & BIG_INTEGERS_AS_FLOAT) != 0)
+		{
+			ZVAL_DOUBLE(value, static_cast<double>(result));
+			return;
+		}
 
-		if (!name.empty())
-			add_assoc_stringl_ex(row, name.c_str(), name.length(), value_string.data(), value_string.length());
+		char buffer[FORMAT_BUFFER_SIZE];
+		size_t length;
+
+		if constexpr (std::is_integral_v<decltype(result)>)
+			length = static_cast<size_t>(std::to_chars(buffer, buffer + sizeof(buffer), result).ptr - buffer);
 		else
-			add_next_index_stringl(row, value_string.data(), value_string.length());
+			length = format_int128(result, buffer, sizeof(buffer));
+
+		ZVAL_STRINGL(value, buffer, length);
 		return;
 	}
 #pragma GCC diagnostic pop
 
-	if (!name.empty())
-		add_assoc_long_ex(row, name.c_str(), name.length(), static_cast<zend_long>(value));
-	else
-		add_next_index_long(row, static_cast<zend_long>(value));
+	ZVAL_LONG(value, static_cast<zend_long>(result));
 }
 
 template<class T>
-void ClickHouseResult::add_float(zval *row, const ColumnRef &column, const string &name) const
+void ClickHouseResult::set_float(zval *value, const ColumnRef &column) const
 {
-	auto value = column->As<T>()->At(this->next_row);
-
-	if (!name.empty())
-		add_assoc_double_ex(row, name.c_str(), name.length(), value);
-	else
-		add_next_index_double(row, value);
+	ZVAL_DOUBLE(value, column->As<T>()->At(this->next_row));
 }
 
 template<class T>
-void ClickHouseResult::add_string(zval *row, const ColumnRef &column, const string &name) const
+void ClickHouseResult::set_string(zval *value, const ColumnRef &column) const
 {
 	auto result = column->As<T>()->At(this->next_row);
-	string_view value;
-	string tmp_string;
 
-	if constexpr (std::is_same_v<std::decay_t<decltype(result)>, UUID>)
+	if constexpr (std::is_same_v<std::decay_t<decltype(result)>, UUID> || std::is_same_v<std::decay_t<decltype(result)>, in_addr> || std::is_same_v<std::decay_t<decltype(result)>, in6_addr>)
+		ZVAL_NEW_STR(value, format_zend_string(result));
+	else
+		ZVAL_STRINGL(value, result.data(), result.length());
+}
+
+template<zend_long Mapping, class T>
+void ClickHouseResult::set_date(zval *value, const ColumnRef &column) const
+{
+	if constexpr ((Mapping & DATES_AS_TIMESTAMPS) != 0)
 	{
-		tmp_string = uuid_to_string(result);
-		value = tmp_string;
+		auto typed = column->As<T>();
+
+		if constexpr (std::is_same_v<T, ColumnDateTime64>)
+			ZVAL_DOUBLE(value, static_cast<double>(typed->At(this->next_row)) / std::pow(10.0, typed->GetPrecision()));
+		else
+			ZVAL_LONG(value, static_cast<zend_long>(typed->At(this->next_row)));
+		return;
 	}
-	else if constexpr (std::is_same_v<std::decay_t<decltype(result)>, in_addr> || std::is_same_v<std::decay_t<decltype(result)>, in6_addr>)
+
+	time_t timestamp = column->As<T>()->At(this->next_row) + this->timezone_offset;
+
+	char buffer[20];		//2020-01-01 00:00:00 + \0
+	size_t writed = format_date(timestamp, std::is_same<T, ColumnDateTime>{}, buffer, sizeof(buffer));
+	if (writed == 0)
+		zend_error_noreturn(E_ERROR, "Failed to format DateTime to string");
+
+	ZVAL_STRINGL(value, buffer, writed);
+}
+
+template<zend_long Mapping>
+void ClickHouseResult::set_decimal(zval *value, const ColumnRef &column) const
+{
+	auto decimal = column->As<ColumnDecimal>();
+
+	if constexpr ((Mapping & DECIMALS_AS_FLOAT) != 0)
 	{
-		tmp_string = column->As<T>()->AsString(this->next_row);
-		value = tmp_string;
+		auto type_decimal = reinterpret_cast<DecimalType*>(decimal->Type().get());
+
+		ZVAL_DOUBLE(value, static_cast<double>(decimal->At(this->next_row)) / std::pow(10.0, type_decimal->GetScale()));
+		return;
 	}
-	else
-		value = result;
 
-	if (!name.empty())
-		add_assoc_stringl_ex(row, name.c_str(), name.length(), value.data(), value.length());
-	else
-		add_next_index_stringl(row, value.data(), value.length());
+	char buffer[FORMAT_BUFFER_SIZE];
+
+	ZVAL_STRINGL(value, buffer, format_decimal(*decimal, this->next_row, buffer, sizeof(buffer)));
 }
 
 template<class T>
-void ClickHouseResult::add_date(zval *row, const ColumnRef &column, const string &name) const
+void ClickHouseResult::set_enum(zval *value, const ColumnRef &column, size_t index) const
 {
-	time_t value = column->As<T>()->At(this->next_row) + this->timezone_offset;
+	int16_t code = column->As<T>()->At(this->next_row);
 
-	tm tm_time{};
-	gmtime_r(&value, &tm_time);
+	const EnumNames &enum_names = this->get_enum_names(column, index);
 
-	char buffer[20];		//2020-01-01 00:00:00 + \0
-	size_t writed = strftime(buffer, sizeof(buffer), std::is_same<T, ColumnDateTime>{} ? DATETIME_FORMAT : DATE_FORMAT, &tm_time);
-	if (writed == 0)
-		zend_error_noreturn(E_ERROR, "Failed to format DateTime to string");
+	// Codes missing from the type can only come from a changed table, they are returned as is
+	auto offset = static_cast<size_t>(code - enum_names.min_value);
+	if (code < enum_names.min_value || offset >= enum_names.names.size() || enum_names.names[offset] == nullptr)
+	{
+		ZVAL_LONG(value, code);
+		return;
+	}
 
-	if (!name.empty())
-		add_assoc_stringl_ex(row, name.c_str(), name.length(), buffer, writed);
-	else
-		add_next_index_stringl(row, buffer, writed);
+	ZVAL_STR_COPY(value, enum_names.names[offset]);
 }
\ No newline at end of file
@@ -0,0 +1,114 @@
+#include "ClickHouseSlowLog.h"
+
+#include "ClickHouseExport.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+
+static constexpr double NANOSECONDS = 1000000000.0;
+
+ClickHouseSlowLog::ClickHouseSlowLog(const ClickHouseStats *stats, const char *type, const string &text):
+	stats(stats), start_stats(), type(type), text(text), enabled(false), start(0), transfer_start(0), rows(0), bytes(0), failed(false)
+{
+	const char *path = CLICKHOUSE_G(slow_log);
+	if (path == nullptr || *path == '\0' || CLICKHOUSE_G(slow_threshold_ms) < 0)
+		return;
+
+	this->enabled = true;
+	this->start_stats = *stats;
+	this->start = ClickHouseStats::now();
+}
+
+ClickHouseSlowLog::~ClickHouseSlowLog()
+{
+	if (!this->enabled)
+		return;
+
+	uint64_t duration = ClickHouseStats::now() - this->start;
+	if (duration < ClickHouseSlowLog::get_threshold())
+		return;
+
+	// Only one of each slow_log_sample slow calls is written
+	zend_long sample = std::max<zend_long>(CLICKHOUSE_G(slow_log_sample), 1);
+	if (CLICKHOUSE_G(slow_log_calls)++ % static_cast<uint64_t>(sample) != 0)
+		return;
+
+	this->write(duration);
+}
+
+auto ClickHouseSlowLog::is_slow() const -> bool
+{
+	return this->enabled && ClickHouseStats::now() - this->start >= ClickHouseSlowLog::get_threshold();
+}
+
+auto ClickHouseSlowLog::get_threshold() -> uint64_t
+{
+	return static_cast<uint64_t>(CLICKHOUSE_G(slow_threshold_ms)) * 1000000;
+}
+
+void ClickHouseSlowLog::start_transfer()
+{
+	if (this->enabled && this->transfer_start == 0)
+		this->transfer_start = ClickHouseStats::now();
+}
+
+void ClickHouseSlowLog::set_result(uint64_t rows, uint64_t bytes)
+{
+	this->rows = rows;
+	this->bytes = bytes;
+}
+
+void ClickHouseSlowLog::set_failed()
+{
+	this->failed = true;
+}
+
+void ClickHouseSlowLog::write(uint64_t duration) const
+{
+	uint64_t connect = this->stats->connect_time - this->start_stats.connect_time;
+	uint64_t server = this->stats->server_time - this->start_stats.server_time;
+	uint64_t decompression = this->stats->decompression_time - this->start_stats.decompression_time;
+	uint64_t conversion = this->stats->conversion_time - this->start_stats.conversion_time;
+
+	// Server time until the first block is waiting, the rest is transfer
+	uint64_t wait = this->transfer_start != 0 ? std::min(this->transfer_start - this->start, server) : server;
+
+	timespec now{};
+	clock_gettime(CLOCK_REALTIME, &now);
+
+	const char *script = zend_get_executed_filename();
+	uint32_t line = zend_get_executed_lineno();
+
+	string entry;
+	entry.reserve(256 + this->text.size());
+
+	char buffer[512];
+	snprintf(buffer, sizeof(buffer), "{\"time\":%ld.%03ld,\"pid\":%d,\"script\":", static_cast<long>(now.tv_sec), now.tv_nsec / 1000000, getpid());
+	entry.append(buffer);
+
+	ClickHouseExport::add_json_string(entry, script != nullptr ? script : "");
+
+	snprintf(buffer, sizeof(buffer), ",\"line\":%u,\"type\":\"%s\",\"text\":", line, this->type);
+	entry.append(buffer);
+
+	ClickHouseExport::add_json_string(entry, this->text);
+
+	snprintf(buffer, sizeof(buffer), ",\"rows\":%" PRIu64 ",\"bytes\":%" PRIu64 ",\"failed\":%s,\"duration\":%.6f,\"connect\":%.6f,\"wait\":%.6f,\"transfer\":%.6f,\"decompression\":%.6f,\"conversion\":%.6f}\n",
+		this->rows, this->bytes, this->failed ? "true" : "false",
+		static_cast<double>(duration) / NANOSECONDS, static_cast<double>(connect) / NANOSECONDS, static_cast<double>(wait) / NANOSECONDS,
+		static_cast<double>(server - wait) / NANOSECONDS, static_cast<double>(decompression) / NANOSECONDS, static_cast<double>(conversion) / NANOSECONDS);
+	entry.append(buffer);
+
+	// Single append write keeps lines of concurrent workers whole
+	int fd = open(CLICKHOUSE_G(slow_log), O_WRONLY | O_APPEND | O_CREAT | O_CLOEXEC, 0644);
+	if (fd == -1)
+	{
+		zend_error(E_WARNING, "Failed to open slow log %s: %s", CLICKHOUSE_G(slow_log), strerror(errno));
+		return;
+	}
+
+	if (::write(fd, entry.data(), entry.size()) != static_cast<ssize_t>(entry.size()))
+		zend_error(E_WARNING, "Failed to write slow log %s: %s", CLICKHOUSE_G(slow_log), strerror(errno));
+
+	close(fd);
+}
\ No newline at end of file
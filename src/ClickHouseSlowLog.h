@@ -0,0 +1,44 @@
+#pragma once
+
+// Entry of clickhouse.slow_log for a query or insert call, written as a JSON line when the object is destroyed if the
+// call took longer than clickhouse.slow_threshold_ms. Stages are taken from statistics of the connection: connect,
+// waiting for the server until data starts to flow, transfer of data, its decompression and conversion between blocks
+// and PHP values.
+class ClickHouseSlowLog
+{
+private:
+	const ClickHouseStats *stats;
+	ClickHouseStats start_stats;
+
+	const char *type;
+	const string &text;
+
+	bool enabled;
+
+	uint64_t start;
+	uint64_t transfer_start;
+
+	uint64_t rows;
+	uint64_t bytes;
+	bool failed;
+
+	void write(uint64_t duration) const;
+
+	[[nodiscard]] static auto get_threshold() -> uint64_t;
+
+public:
+	ClickHouseSlowLog(const ClickHouseStats *stats, const char *type, const string &text);
+	~ClickHouseSlowLog();
+
+	ClickHouseSlowLog(const ClickHouseSlowLog&) = delete;
+	auto operator=(const ClickHouseSlowLog&) -> ClickHouseSlowLog& = delete;
+
+	// Call already took longer than the threshold, for values worth computing only for written entries
+	[[nodiscard]] auto is_slow() const -> bool;
+
+	// First block is received or data starts to be sent, time before that is waiting
+	void start_transfer();
+
+	void set_result(uint64_t rows, uint64_t bytes);
+	void set_failed();
+};
\ No newline at end of file
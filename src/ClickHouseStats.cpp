@@ -0,0 +1,95 @@
+#include "ClickHouseStats.h"
+
+static constexpr double NANOSECONDS = 1000000000.0;
+
+void ClickHouseStats::to_array(zval *array) const
+{
+	array_init_size(array, 19);
+
+	add_assoc_long(array, "connects", static_cast<zend_long>(this->connects));
+	add_assoc_long(array, "queries", static_cast<zend_long>(this->queries));
+	add_assoc_long(array, "inserts", static_cast<zend_long>(this->inserts));
+	add_assoc_long(array, "errors", static_cast<zend_long>(this->errors));
+
+	add_assoc_long(array, "rows_received", static_cast<zend_long>(this->rows_received));
+	add_assoc_long(array, "blocks_received", static_cast<zend_long>(this->blocks_received));
+	add_assoc_long(array, "bytes_received", static_cast<zend_long>(this->bytes_received));
+	add_assoc_long(array, "compressed_bytes", static_cast<zend_long>(this->compressed_bytes));
+	add_assoc_long(array, "decompressed_bytes", static_cast<zend_long>(this->decompressed_bytes));
+
+	add_assoc_long(array, "rows_sent", static_cast<zend_long>(this->rows_sent));
+	add_assoc_long(array, "blocks_sent", static_cast<zend_long>(this->blocks_sent));
+	add_assoc_long(array, "bytes_sent", static_cast<zend_long>(this->bytes_sent));
+
+	add_assoc_long(array, "cache_hits", static_cast<zend_long>(this->cache_hits));
+	add_assoc_long(array, "cache_misses", static_cast<zend_long>(this->cache_misses));
+
+	add_assoc_long(array, "bytes_spilled", static_cast<zend_long>(this->bytes_spilled));
+
+	add_assoc_double(array, "connect_time", static_cast<double>(this->connect_time) / NANOSECONDS);
+	add_assoc_double(array, "server_time", static_cast<double>(this->server_time) / NANOSECONDS);
+	add_assoc_double(array, "decompression_time", static_cast<double>(this->decompression_time) / NANOSECONDS);
+	add_assoc_double(array, "conversion_time", static_cast<double>(this->conversion_time) / NANOSECONDS);
+}
+
+void ClickHouseStats::print_info() const
+{
+	zval array;
+	this->to_array(&array);
+
+	zend_string *name;
+	zval *value;
+	ZEND_HASH_FOREACH_STR_KEY_VAL(Z_ARR(array), name, value)
+	{
+		zend_string *text = zval_get_string(value);
+
+		php_info_print_table_row(2, ZSTR_VAL(name), ZSTR_VAL(text));
+
+		zend_string_release(text);
+	}
+	ZEND_HASH_FOREACH_END();
+
+	zval_ptr_dtor(&array);
+}
+
+auto ClickHouseStats::now() -> uint64_t
+{
+	return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+
+void clickhouse_stats_add(ClickHouseStats *stats, uint64_t ClickHouseStats::*counter, uint64_t value)
+{
+	if (stats != nullptr)
+		stats->*counter += value;
+
+	CLICKHOUSE_G(stats).*counter += value;
+}
+
+void clickhouse_stats_add_decompression(ClickHouseStats *stats, const DecompressStats &decompression)
+{
+	clickhouse_stats_add(stats, &ClickHouseStats::compressed_bytes, decompression.compressed_bytes);
+	clickhouse_stats_add(stats, &ClickHouseStats::decompressed_bytes, decompression.decompressed_bytes);
+	clickhouse_stats_add(stats, &ClickHouseStats::decompression_time, decompression.time);
+}
+
+ClickHouseTimer::ClickHouseTimer(ClickHouseStats *stats, uint64_t ClickHouseStats::*counter):
+	stats(stats), counter(counter), start(ClickHouseStats::now())
+{}
+
+ClickHouseTimer::~ClickHouseTimer()
+{
+	clickhouse_stats_add(this->stats, this->counter, ClickHouseStats::now() - this->start);
+}
+
+ClickHouseServerTimer::ClickHouseServerTimer(ClickHouseStats *stats):
+	stats(stats), start(ClickHouseStats::now()), start_decompression(lz4_get_thread_stats())
+{}
+
+ClickHouseServerTimer::~ClickHouseServerTimer()
+{
+	DecompressStats decompression = lz4_get_stats_since(this->start_decompression);
+	uint64_t duration = ClickHouseStats::now() - this->start;
+
+	clickhouse_stats_add_decompression(this->stats, decompression);
+	clickhouse_stats_add(this->stats, &ClickHouseStats::server_time, duration - std::min(decompression.time, duration));
+}
\ No newline at end of file
@@ -0,0 +1,83 @@
+#pragma once
+
+#include "lz4_dispatch.h"
+
+#include <chrono>
+
+// Counters are kept per connection and per process (module globals), times are in nanoseconds
+struct ClickHouseStats
+{
+	uint64_t connects;
+	uint64_t queries;
+	uint64_t inserts;
+	uint64_t errors;
+
+	uint64_t rows_received;
+	uint64_t blocks_received;
+	uint64_t bytes_received;
+
+	// Network blocks as they come compressed and after decompression
+	uint64_t compressed_bytes;
+	uint64_t decompressed_bytes;
+
+	uint64_t rows_sent;
+	uint64_t blocks_sent;
+	// Uncompressed size of sent blocks, estimated from their columns
+	uint64_t bytes_sent;
+
+	// Lookups in the shared query cache
+	uint64_t cache_hits;
+	uint64_t cache_misses;
+
+	// Serialized blocks of buffered results written to temporary files
+	uint64_t bytes_spilled;
+
+	// Time inside clickhouse-cpp: connecting, waiting for the server and receiving blocks, decompression is apart
+	uint64_t connect_time;
+	uint64_t server_time;
+	uint64_t decompression_time;
+
+	// Time of conversion between blocks and PHP values
+	uint64_t conversion_time;
+
+	void to_array(zval *array) const;
+	void print_info() const;
+
+	[[nodiscard]] static auto now() -> uint64_t;
+};
+
+void clickhouse_stats_add(ClickHouseStats *stats, uint64_t ClickHouseStats::*counter, uint64_t value);
+void clickhouse_stats_add_decompression(ClickHouseStats *stats, const DecompressStats &decompression);
+
+class ClickHouseTimer
+{
+private:
+	ClickHouseStats *stats;
+	uint64_t ClickHouseStats::*counter;
+
+	uint64_t start;
+
+public:
+	ClickHouseTimer(ClickHouseStats *stats, uint64_t ClickHouseStats::*counter);
+	~ClickHouseTimer();
+
+	ClickHouseTimer(const ClickHouseTimer&) = delete;
+	auto operator=(const ClickHouseTimer&) -> ClickHouseTimer& = delete;
+};
+
+// Server time of clickhouse-cpp calls on the calling thread, blocks decompressed meanwhile go to decompression_time instead
+class ClickHouseServerTimer
+{
+private:
+	ClickHouseStats *stats;
+
+	uint64_t start;
+	DecompressStats start_decompression;
+
+public:
+	explicit ClickHouseServerTimer(ClickHouseStats *stats);
+	~ClickHouseServerTimer();
+
+	ClickHouseServerTimer(const ClickHouseServerTimer&) = delete;
+	auto operator=(const ClickHouseServerTimer&) -> ClickHouseServerTimer& = delete;
+};
\ No newline at end of file
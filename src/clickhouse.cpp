@@ -5,6 +5,8 @@
 #include "ClickHouseDB.h"
 #include "ClickHouseResult.h"
 
+#include <unistd.h>
+
 static constexpr auto MODULE_VERSION = "1.0.0";
 
 struct ClickHouseObject
@@ -49,10 +51,151 @@ __inline static void clickhouse_free(zend_object *obj)
 	ch_obj->impl = nullptr;
 }
 
+#if PHP_API_VERSION >= 20210902
+using iterator_result = zend_result;
+#else
+using iterator_result = int;
+#endif
+
+struct ClickHouseResultIterator
+{
+	zend_object_iterator intern;
+	zval current;
+	zend_long key;
+	bool started;
+};
+
+__inline static void clickhouse_result_iterator_fetch(ClickHouseResultIterator *iterator)
+{
+	zval_ptr_dtor(&iterator->current);
+	ZVAL_UNDEF(&iterator->current);
+
+	auto obj = Z_CLICKHOUSE_RESULT_P(&iterator->intern.data);
+	if (obj->impl == nullptr)
+		return;
+
+	// Row number in the whole result, not in the current block
+	iterator->key = static_cast<zend_long>(obj->impl->get_position());
+
+	if (!obj->impl->fetch_array(&iterator->current, obj->impl->get_iterator_type()))
+	{
+		zval_ptr_dtor(&iterator->current);
+		ZVAL_UNDEF(&iterator->current);
+	}
+}
+
+static void clickhouse_result_iterator_dtor(zend_object_iterator *iter)
+{
+	auto iterator = reinterpret_cast<ClickHouseResultIterator*>(iter);
+
+	zval_ptr_dtor(&iterator->current);
+	zval_ptr_dtor(&iterator->intern.data);
+}
+
+static auto clickhouse_result_iterator_valid(zend_object_iterator *iter) -> iterator_result
+{
+	auto iterator = reinterpret_cast<ClickHouseResultIterator*>(iter);
+
+	return Z_TYPE(iterator->current) != IS_UNDEF ? SUCCESS : FAILURE;
+}
+
+static auto clickhouse_result_iterator_get_current_data(zend_object_iterator *iter) -> zval*
+{
+	auto iterator = reinterpret_cast<ClickHouseResultIterator*>(iter);
+
+	return &iterator->current;
+}
+
+static void clickhouse_result_iterator_get_current_key(zend_object_iterator *iter, zval *key)
+{
+	auto iterator = reinterpret_cast<ClickHouseResultIterator*>(iter);
+
+	ZVAL_LONG(key, iterator->key);
+}
+
+static void clickhouse_result_iterator_move_forward(zend_object_iterator *iter)
+{
+	clickhouse_result_iterator_fetch(reinterpret_cast<ClickHouseResultIterator*>(iter));
+}
+
+static void clickhouse_result_iterator_rewind(zend_object_iterator *iter)
+{
+	auto iterator = reinterpret_cast<ClickHouseResultIterator*>(iter);
+
+	auto obj = Z_CLICKHOUSE_RESULT_P(&iterator->intern.data);
+
+	// Seekable result starts from the first row each time, otherwise it's read forward only and iteration continues from the current row
+	if (obj->impl != nullptr && obj->impl->is_seekable())
+	{
+		if (!obj->impl->data_seek(0))
+		{
+			zval_ptr_dtor(&iterator->current);
+			ZVAL_UNDEF(&iterator->current);
+			return;
+		}
+	}
+	else if (iterator->started)
+		return;
+
+	iterator->started = true;
+	clickhouse_result_iterator_fetch(iterator);
+}
+
+static const zend_object_iterator_funcs clickhouse_result_iterator_funcs = {
+	clickhouse_result_iterator_dtor,
+	clickhouse_result_iterator_valid,
+	clickhouse_result_iterator_get_current_data,
+	clickhouse_result_iterator_get_current_key,
+	clickhouse_result_iterator_move_forward,
+	clickhouse_result_iterator_rewind,
+	nullptr,
+#if PHP_API_VERSION >= 20200930
+	nullptr
+#endif
+};
+
+static auto clickhouse_result_get_iterator(zend_class_entry *ce, zval *object, int by_ref) -> zend_object_iterator*
+{
+	if (by_ref)
+	{
+		zend_throw_error(nullptr, "An iterator cannot be used with foreach by reference");
+		return nullptr;
+	}
+
+	auto iterator = static_cast<ClickHouseResultIterator*>(emalloc(sizeof(ClickHouseResultIterator)));
+
+	zend_iterator_init(&iterator->intern);
+
+	Z_ADDREF_P(object);
+	ZVAL_OBJ(&iterator->intern.data, Z_OBJ_P(object));
+
+	iterator->intern.funcs = &clickhouse_result_iterator_funcs;
+
+	ZVAL_UNDEF(&iterator->current);
+	iterator->key = 0;
+	iterator->started = false;
+
+	return &iterator->intern;
+}
+
 ZEND_DECLARE_MODULE_GLOBALS(clickhouse)
 
+PHP_INI_BEGIN()
+	STD_PHP_INI_ENTRY("clickhouse.async_flush_rows", "10000", PHP_INI_SYSTEM, OnUpdateLong, async_flush_rows, zend_clickhouse_globals, clickhouse_globals)
+	STD_PHP_INI_ENTRY("clickhouse.async_flush_interval_ms", "1000", PHP_INI_SYSTEM, OnUpdateLong, async_flush_interval_ms, zend_clickhouse_globals, clickhouse_globals)
+	STD_PHP_INI_ENTRY("clickhouse.async_max_rows", "1000000", PHP_INI_SYSTEM, OnUpdateLong, async_max_rows, zend_clickhouse_globals, clickhouse_globals)
+	STD_PHP_INI_ENTRY("clickhouse.cache_size", "0", PHP_INI_SYSTEM, OnUpdateLong, cache_size, zend_clickhouse_globals, clickhouse_globals)
+	STD_PHP_INI_ENTRY("clickhouse.spill_threshold", "0", PHP_INI_ALL, OnUpdateLong, spill_threshold, zend_clickhouse_globals, clickhouse_globals)
+	STD_PHP_INI_ENTRY("clickhouse.slow_log", "", PHP_INI_ALL, OnUpdateString, slow_log, zend_clickhouse_globals, clickhouse_globals)
+	STD_PHP_INI_ENTRY("clickhouse.slow_threshold_ms", "1000", PHP_INI_ALL, OnUpdateLong, slow_threshold_ms, zend_clickhouse_globals, clickhouse_globals)
+	STD_PHP_INI_ENTRY("clickhouse.slow_log_sample", "1", PHP_INI_ALL, OnUpdateLong, slow_log_sample, zend_clickhouse_globals, clickhouse_globals)
+PHP_INI_END()
+
 ZEND_MODULE_GLOBALS_CTOR_D(clickhouse)
-{}
+{
+	clickhouse_globals->stats = {};
+	clickhouse_globals->slow_log_calls = 0;
+}
 
 ZEND_MODULE_GLOBALS_DTOR_D(clickhouse)
 {}
@@ -63,6 +206,7 @@ ZEND_BEGIN_ARG_INFO_EX(arginfo_clickhouse_construct, 0, 0, 0)
 	ZEND_ARG_TYPE_INFO(0, passwd, IS_STRING, 0)
 	ZEND_ARG_TYPE_INFO(0, dbname, IS_STRING, 0)
 	ZEND_ARG_TYPE_INFO(0, port, IS_LONG, 0)
+	ZEND_ARG_TYPE_INFO(0, settings, IS_ARRAY, 0)
 ZEND_END_ARG_INFO()
 
 PHP_METHOD(ClickHouseObject, __construct)
@@ -72,19 +216,21 @@ PHP_METHOD(ClickHouseObject, __construct)
 	zend_string *passwd = nullptr;
 	zend_string *dbname = nullptr;
 	zend_long port = 0;
+	zend_array *settings = nullptr;
 
-	ZEND_PARSE_PARAMETERS_START(0, 5)
+	ZEND_PARSE_PARAMETERS_START(0, 6)
 		Z_PARAM_OPTIONAL
 		Z_PARAM_STR(host)
 		Z_PARAM_STR(username)
 		Z_PARAM_STR(passwd)
 		Z_PARAM_STR(dbname)
 		Z_PARAM_LONG(port)
+		Z_PARAM_ARRAY_HT(settings)
 	ZEND_PARSE_PARAMETERS_END();
 
 	auto ch = Z_CLICKHOUSE_P(ZEND_THIS);
 
-	ch->impl->connect(host, username, passwd, dbname, port);
+	ch->impl->connect(host, username, passwd, dbname, port, settings);
 }
 
 // ReSharper disable once CppVariableCanBeMadeConstexpr
@@ -102,27 +248,33 @@ PHP_METHOD(ClickHouseObject, __destruct)
 ZEND_BEGIN_ARG_INFO_EX(arginfo_clickhouse_query, 0, 0, 1)
 	ZEND_ARG_TYPE_INFO(0, query, IS_STRING, 0)
 	ZEND_ARG_TYPE_INFO(0, resultmode, IS_LONG, 0)
+	ZEND_ARG_TYPE_INFO(0, settings, IS_ARRAY, 1)
+	ZEND_ARG_TYPE_INFO(0, cache_ttl, IS_LONG, 0)
+	ZEND_ARG_TYPE_INFO(0, external_tables, IS_ARRAY, 0)
 ZEND_END_ARG_INFO()
 
 PHP_METHOD(ClickHouseObject, query)
 {
 	zend_string *query;
-	zend_long resultmode;
+	zend_long resultmode = ClickHouseResult::STORE_RESULT;
+	zend_array *settings = nullptr;
+	zend_long cache_ttl = 0;
+	zend_array *external_tables = nullptr;
 
-	ZEND_PARSE_PARAMETERS_START(1, 2)
+	ZEND_PARSE_PARAMETERS_START(1, 5)
 		Z_PARAM_STR(query)
 		Z_PARAM_OPTIONAL
 		Z_PARAM_LONG(resultmode)
+		Z_PARAM_ARRAY_HT_EX(settings, 1, 0)
+		Z_PARAM_LONG(cache_ttl)
+		Z_PARAM_ARRAY_HT(external_tables)
 	ZEND_PARSE_PARAMETERS_END();
 
-	// For compatibility with mysqli
-	if (resultmode) {}
-
 	auto obj = Z_CLICKHOUSE_P(ZEND_THIS);
 
 	bool success = false;
 
-	zend_object *result = obj->impl->query(string(ZSTR_VAL(query), ZSTR_LEN(query)), success);
+	zend_object *result = obj->impl->query(string(ZSTR_VAL(query), ZSTR_LEN(query)), resultmode, settings, cache_ttl, external_tables, success);
 	if (result == nullptr)
 	{
 		if (success)
@@ -133,10 +285,46 @@ PHP_METHOD(ClickHouseObject, query)
 	RETVAL_OBJ(result);
 }
 
+ZEND_BEGIN_ARG_INFO_EX(arginfo_clickhouse_query_to_stream, 0, 0, 2)
+	ZEND_ARG_TYPE_INFO(0, query, IS_STRING, 0)
+	ZEND_ARG_INFO(0, stream)
+	ZEND_ARG_TYPE_INFO(0, format, IS_LONG, 0)
+ZEND_END_ARG_INFO()
+
+PHP_METHOD(ClickHouseObject, query_to_stream)
+{
+	zend_string *query;
+	zval *zstream;
+	zend_long format = static_cast<zend_long>(ClickHouseExport::Format::CSV);
+
+	ZEND_PARSE_PARAMETERS_START(2, 3)
+		Z_PARAM_STR(query)
+		Z_PARAM_RESOURCE(zstream)
+		Z_PARAM_OPTIONAL
+		Z_PARAM_LONG(format)
+	ZEND_PARSE_PARAMETERS_END();
+
+	php_stream *stream;
+	php_stream_from_zval(stream, zstream);
+
+	ClickHouseExport::Format export_format;
+	if (!ClickHouseExport::get_format(format, export_format))
+		RETURN_FALSE;
+
+	auto obj = Z_CLICKHOUSE_P(ZEND_THIS);
+
+	// ReSharper disable once CppTooWideScope
+	bool result = obj->impl->query_to_stream(string(ZSTR_VAL(query), ZSTR_LEN(query)), stream, export_format);
+	if (result)
+		RETURN_TRUE;
+	RETURN_FALSE;
+}
+
 ZEND_BEGIN_ARG_INFO_EX(arginfo_clickhouse_insert, 0, 0, 2)
 	ZEND_ARG_TYPE_INFO(0, table_name, IS_STRING, 0)
 	ZEND_ARG_TYPE_INFO(0, values, IS_ARRAY, 0)
-	ZEND_ARG_TYPE_INFO(0, fields, IS_ARRAY, 0)
+	ZEND_ARG_TYPE_INFO(0, fields, IS_ARRAY, 1)
+	ZEND_ARG_TYPE_INFO(0, settings, IS_ARRAY, 0)
 ZEND_END_ARG_INFO()
 
 PHP_METHOD(ClickHouseObject, insert)
@@ -144,23 +332,223 @@ PHP_METHOD(ClickHouseObject, insert)
 	zend_string *table_name;
 	zend_array *values;
 	zend_array *fields = nullptr;
+	zend_array *settings = nullptr;
 
-	ZEND_PARSE_PARAMETERS_START(2, 3)
+	ZEND_PARSE_PARAMETERS_START(2, 4)
+		Z_PARAM_STR(table_name)
+		Z_PARAM_ARRAY_HT(values)
+		Z_PARAM_OPTIONAL
+		Z_PARAM_ARRAY_HT_EX(fields, 1, 0)
+		Z_PARAM_ARRAY_HT(settings)
+	ZEND_PARSE_PARAMETERS_END();
+
+	auto obj = Z_CLICKHOUSE_P(ZEND_THIS);
+
+	// ReSharper disable once CppTooWideScope
+	bool result = obj->impl->insert(string(ZSTR_VAL(table_name), ZSTR_LEN(table_name)), values, fields, settings, false);
+	if (result)
+		RETURN_TRUE;
+	RETURN_FALSE;
+}
+
+PHP_METHOD(ClickHouseObject, insert_async)
+{
+	zend_string *table_name;
+	zend_array *values;
+	zend_array *fields = nullptr;
+	zend_array *settings = nullptr;
+
+	ZEND_PARSE_PARAMETERS_START(2, 4)
 		Z_PARAM_STR(table_name)
 		Z_PARAM_ARRAY_HT(values)
 		Z_PARAM_OPTIONAL
-		Z_PARAM_ARRAY_HT(fields)
+		Z_PARAM_ARRAY_HT_EX(fields, 1, 0)
+		Z_PARAM_ARRAY_HT(settings)
 	ZEND_PARSE_PARAMETERS_END();
 
 	auto obj = Z_CLICKHOUSE_P(ZEND_THIS);
 
 	// ReSharper disable once CppTooWideScope
-	bool result = obj->impl->insert(string(ZSTR_VAL(table_name), ZSTR_LEN(table_name)), values, fields);
+	bool result = obj->impl->insert(string(ZSTR_VAL(table_name), ZSTR_LEN(table_name)), values, fields, settings, true);
 	if (result)
 		RETURN_TRUE;
 	RETURN_FALSE;
 }
 
+// ReSharper disable once CppVariableCanBeMadeConstexpr
+ZEND_BEGIN_ARG_INFO_EX(arginfo_clickhouse_start_query, 0, 0, 1)
+	ZEND_ARG_TYPE_INFO(0, query, IS_STRING, 0)
+	ZEND_ARG_TYPE_INFO(0, resultmode, IS_LONG, 0)
+	ZEND_ARG_TYPE_INFO(0, settings, IS_ARRAY, 1)
+ZEND_END_ARG_INFO()
+
+PHP_METHOD(ClickHouseObject, start_query)
+{
+	zend_string *query;
+	zend_long resultmode = ClickHouseResult::STORE_RESULT;
+	zend_array *settings = nullptr;
+
+	ZEND_PARSE_PARAMETERS_START(1, 3)
+		Z_PARAM_STR(query)
+		Z_PARAM_OPTIONAL
+		Z_PARAM_LONG(resultmode)
+		Z_PARAM_ARRAY_HT_EX(settings, 1, 0)
+	ZEND_PARSE_PARAMETERS_END();
+
+	auto obj = Z_CLICKHOUSE_P(ZEND_THIS);
+
+	if (obj->impl->start_query(string(ZSTR_VAL(query), ZSTR_LEN(query)), resultmode, settings))
+		RETURN_TRUE;
+	RETURN_FALSE;
+}
+
+// ReSharper disable once CppVariableCanBeMadeConstexpr
+ZEND_BEGIN_ARG_INFO_EX(arginfo_clickhouse_get_stream, 0, 0, 0)
+ZEND_END_ARG_INFO()
+
+PHP_METHOD(ClickHouseObject, get_stream)
+{
+	ZEND_PARSE_PARAMETERS_NONE();
+
+	auto obj = Z_CLICKHOUSE_P(ZEND_THIS);
+
+	int fd = obj->impl->get_notify_fd();
+	if (fd == -1)
+		RETURN_FALSE;
+
+	// Stream has its own descriptor, it can be closed by PHP without affecting the connection
+	fd = dup(fd);
+	if (fd == -1)
+	{
+		zend_error(E_WARNING, "Failed to duplicate event descriptor: %s", strerror(errno));
+		RETURN_FALSE;
+	}
+
+	php_stream *stream = php_stream_fopen_from_fd(fd, "r", nullptr);
+	if (stream == nullptr)
+	{
+		close(fd);
+		RETURN_FALSE;
+	}
+
+	php_stream_to_zval(stream, return_value);
+}
+
+// ReSharper disable once CppVariableCanBeMadeConstexpr
+ZEND_BEGIN_ARG_INFO_EX(arginfo_clickhouse_process_io, 0, 0, 0)
+ZEND_END_ARG_INFO()
+
+PHP_METHOD(ClickHouseObject, process_io)
+{
+	ZEND_PARSE_PARAMETERS_NONE();
+
+	auto obj = Z_CLICKHOUSE_P(ZEND_THIS);
+
+	if (obj->impl->process_io())
+		RETURN_TRUE;
+	RETURN_FALSE;
+}
+
+// ReSharper disable once CppVariableCanBeMadeConstexpr
+ZEND_BEGIN_ARG_INFO_EX(arginfo_clickhouse_get_result, 0, 0, 0)
+ZEND_END_ARG_INFO()
+
+PHP_METHOD(ClickHouseObject, get_result)
+{
+	ZEND_PARSE_PARAMETERS_NONE();
+
+	auto obj = Z_CLICKHOUSE_P(ZEND_THIS);
+
+	bool success = false;
+
+	zend_object *result = obj->impl->get_result(success);
+	if (result == nullptr)
+	{
+		if (success)
+			RETURN_TRUE;
+		RETURN_FALSE;
+	}
+
+	RETVAL_OBJ(result);
+}
+
+// ReSharper disable once CppVariableCanBeMadeConstexpr
+ZEND_BEGIN_ARG_INFO_EX(arginfo_clickhouse_query_parallel, 0, 0, 2)
+	ZEND_ARG_TYPE_INFO(0, query, IS_STRING, 0)
+	ZEND_ARG_TYPE_INFO(0, endpoints, IS_ARRAY, 0)
+	ZEND_ARG_TYPE_INFO(0, merge, IS_LONG, 0)
+	ZEND_ARG_TYPE_INFO(0, key, IS_STRING, 1)
+	ZEND_ARG_TYPE_INFO(0, resultmode, IS_LONG, 0)
+	ZEND_ARG_TYPE_INFO(0, settings, IS_ARRAY, 1)
+ZEND_END_ARG_INFO()
+
+PHP_METHOD(ClickHouseObject, query_parallel)
+{
+	zend_string *query;
+	zend_array *endpoints;
+	zend_long merge = static_cast<zend_long>(ClickHouseParallelQuery::Merge::CONCAT);
+	zend_string *key = nullptr;
+	zend_long resultmode = ClickHouseResult::STORE_RESULT;
+	zend_array *settings = nullptr;
+
+	ZEND_PARSE_PARAMETERS_START(2, 6)
+		Z_PARAM_STR(query)
+		Z_PARAM_ARRAY_HT(endpoints)
+		Z_PARAM_OPTIONAL
+		Z_PARAM_LONG(merge)
+		Z_PARAM_STR_EX(key, 1, 0)
+		Z_PARAM_LONG(resultmode)
+		Z_PARAM_ARRAY_HT_EX(settings, 1, 0)
+	ZEND_PARSE_PARAMETERS_END();
+
+	auto obj = Z_CLICKHOUSE_P(ZEND_THIS);
+
+	bool success = false;
+
+	zend_object *result = obj->impl->query_parallel(string(ZSTR_VAL(query), ZSTR_LEN(query)), endpoints, merge, key, resultmode, settings, success);
+	if (result == nullptr)
+	{
+		if (success)
+			RETURN_TRUE;
+		RETURN_FALSE;
+	}
+
+	RETVAL_OBJ(result);
+}
+
+// ReSharper disable once CppVariableCanBeMadeConstexpr
+ZEND_BEGIN_ARG_INFO_EX(arginfo_clickhouse_set_type_mapping, 0, 0, 1)
+	ZEND_ARG_TYPE_INFO(0, mapping, IS_LONG, 0)
+ZEND_END_ARG_INFO()
+
+PHP_METHOD(ClickHouseObject, set_type_mapping)
+{
+	zend_long mapping;
+
+	ZEND_PARSE_PARAMETERS_START(1, 1)
+		Z_PARAM_LONG(mapping)
+	ZEND_PARSE_PARAMETERS_END();
+
+	auto obj = Z_CLICKHOUSE_P(ZEND_THIS);
+
+	if (obj->impl->set_type_mapping(mapping))
+		RETURN_TRUE;
+	RETURN_FALSE;
+}
+
+// ReSharper disable once CppVariableCanBeMadeConstexpr
+ZEND_BEGIN_ARG_INFO_EX(arginfo_clickhouse_get_stats, 0, 0, 0)
+ZEND_END_ARG_INFO()
+
+PHP_METHOD(ClickHouseObject, get_stats)
+{
+	ZEND_PARSE_PARAMETERS_NONE();
+
+	auto obj = Z_CLICKHOUSE_P(ZEND_THIS);
+
+	obj->impl->get_stats(return_value);
+}
+
 // ReSharper disable once CppVariableCanBeMadeConstexpr
 ZEND_BEGIN_ARG_INFO_EX(arginfo_clickhouse_result_destruct, 0, 0, 0)
 ZEND_END_ARG_INFO()
@@ -245,7 +633,208 @@ PHP_METHOD(ClickHouseResultObject, fetch_all)
 		RETURN_FALSE;
 }
 
-static constexpr zend_function_entry extension_functions[] = {
+// ReSharper disable once CppVariableCanBeMadeConstexpr
+ZEND_BEGIN_ARG_INFO_EX(arginfo_clickhouse_result_fetch_many, 0, 0, 1)
+	ZEND_ARG_TYPE_INFO(0, count, IS_LONG, 0)
+	ZEND_ARG_TYPE_INFO(0, resulttype, IS_LONG, 0)
+ZEND_END_ARG_INFO()
+
+PHP_METHOD(ClickHouseResultObject, fetch_many)
+{
+	zend_long count;
+	zend_long resulttype = static_cast<zend_long>(ClickHouseResult::FetchType::NUM);
+
+	ZEND_PARSE_PARAMETERS_START(1, 2)
+		Z_PARAM_LONG(count)
+		Z_PARAM_OPTIONAL
+		Z_PARAM_LONG(resulttype)
+	ZEND_PARSE_PARAMETERS_END();
+
+	if (count <= 0)
+	{
+		zend_error(E_WARNING, "Count of rows must be positive");
+		RETURN_FALSE;
+	}
+
+	auto obj = Z_CLICKHOUSE_RESULT_P(ZEND_THIS);
+
+	// ReSharper disable once CppTooWideScopeInitStatement
+	ClickHouseResult::FetchType type = ClickHouseResult::get_fetch_type(resulttype);
+
+	if (!obj->impl->fetch_many(return_value, static_cast<size_t>(count), type))
+		RETURN_FALSE;
+}
+
+// ReSharper disable once CppVariableCanBeMadeConstexpr
+ZEND_BEGIN_ARG_INFO_EX(arginfo_clickhouse_result_fetch_block, 0, 0, 0)
+	ZEND_ARG_TYPE_INFO(0, resulttype, IS_LONG, 0)
+ZEND_END_ARG_INFO()
+
+PHP_METHOD(ClickHouseResultObject, fetch_block)
+{
+	zend_long resulttype = static_cast<zend_long>(ClickHouseResult::FetchType::NUM);
+
+	ZEND_PARSE_PARAMETERS_START(0, 1)
+		Z_PARAM_OPTIONAL
+		Z_PARAM_LONG(resulttype)
+	ZEND_PARSE_PARAMETERS_END();
+
+	auto obj = Z_CLICKHOUSE_RESULT_P(ZEND_THIS);
+
+	// ReSharper disable once CppTooWideScopeInitStatement
+	ClickHouseResult::FetchType type = ClickHouseResult::get_fetch_type(resulttype);
+
+	if (!obj->impl->fetch_block(return_value, type))
+		RETURN_FALSE;
+}
+
+// ReSharper disable once CppVariableCanBeMadeConstexpr
+ZEND_BEGIN_ARG_INFO_EX(arginfo_clickhouse_result_data_seek, 0, 0, 1)
+	ZEND_ARG_TYPE_INFO(0, offset, IS_LONG, 0)
+ZEND_END_ARG_INFO()
+
+PHP_METHOD(ClickHouseResultObject, data_seek)
+{
+	zend_long offset;
+
+	ZEND_PARSE_PARAMETERS_START(1, 1)
+		Z_PARAM_LONG(offset)
+	ZEND_PARSE_PARAMETERS_END();
+
+	auto obj = Z_CLICKHOUSE_RESULT_P(ZEND_THIS);
+
+	if (offset < 0 || !obj->impl->data_seek(static_cast<size_t>(offset)))
+		RETURN_FALSE;
+	RETURN_TRUE;
+}
+
+// ReSharper disable once CppVariableCanBeMadeConstexpr
+ZEND_BEGIN_ARG_INFO_EX(arginfo_clickhouse_result_fetch_row_at, 0, 0, 1)
+	ZEND_ARG_TYPE_INFO(0, offset, IS_LONG, 0)
+	ZEND_ARG_TYPE_INFO(0, resulttype, IS_LONG, 0)
+ZEND_END_ARG_INFO()
+
+PHP_METHOD(ClickHouseResultObject, fetch_row_at)
+{
+	zend_long offset;
+	zend_long resulttype = static_cast<zend_long>(ClickHouseResult::FetchType::NUM);
+
+	ZEND_PARSE_PARAMETERS_START(1, 2)
+		Z_PARAM_LONG(offset)
+		Z_PARAM_OPTIONAL
+		Z_PARAM_LONG(resulttype)
+	ZEND_PARSE_PARAMETERS_END();
+
+	auto obj = Z_CLICKHOUSE_RESULT_P(ZEND_THIS);
+
+	// ReSharper disable once CppTooWideScopeInitStatement
+	ClickHouseResult::FetchType type = ClickHouseResult::get_fetch_type(resulttype);
+
+	if (offset < 0 || !obj->impl->fetch_row_at(return_value, static_cast<size_t>(offset), type))
+		RETURN_FALSE;
+}
+
+// ReSharper disable once CppVariableCanBeMadeConstexpr
+ZEND_BEGIN_ARG_INFO_EX(arginfo_clickhouse_result_fetch_object, 0, 0, 0)
+	ZEND_ARG_TYPE_INFO(0, class, IS_STRING, 0)
+	ZEND_ARG_TYPE_INFO(0, constructor_args, IS_ARRAY, 0)
+ZEND_END_ARG_INFO()
+
+PHP_METHOD(ClickHouseResultObject, fetch_object)
+{
+	zend_class_entry *ce = nullptr;
+	HashTable *ctor_args = nullptr;
+
+	ZEND_PARSE_PARAMETERS_START(0, 2)
+		Z_PARAM_OPTIONAL
+		Z_PARAM_CLASS(ce)
+		Z_PARAM_ARRAY_HT(ctor_args)
+	ZEND_PARSE_PARAMETERS_END();
+
+	if (ce == nullptr)
+		ce = zend_standard_class_def;
+
+	auto obj = Z_CLICKHOUSE_RESULT_P(ZEND_THIS);
+
+	if (!obj->impl->fetch_object(return_value, ce, ctor_args))
+		RETURN_FALSE;
+}
+
+// ReSharper disable once CppVariableCanBeMadeConstexpr
+ZEND_BEGIN_ARG_INFO_EX(arginfo_clickhouse_result_fetch_all_objects, 0, 0, 0)
+	ZEND_ARG_TYPE_INFO(0, class, IS_STRING, 0)
+	ZEND_ARG_TYPE_INFO(0, constructor_args, IS_ARRAY, 0)
+ZEND_END_ARG_INFO()
+
+PHP_METHOD(ClickHouseResultObject, fetch_all_objects)
+{
+	zend_class_entry *ce = nullptr;
+	HashTable *ctor_args = nullptr;
+
+	ZEND_PARSE_PARAMETERS_START(0, 2)
+		Z_PARAM_OPTIONAL
+		Z_PARAM_CLASS(ce)
+		Z_PARAM_ARRAY_HT(ctor_args)
+	ZEND_PARSE_PARAMETERS_END();
+
+	if (ce == nullptr)
+		ce = zend_standard_class_def;
+
+	auto obj = Z_CLICKHOUSE_RESULT_P(ZEND_THIS);
+
+	if (!obj->impl->fetch_all_objects(return_value, ce, ctor_args))
+		RETURN_FALSE;
+}
+
+// ReSharper disable once CppVariableCanBeMadeConstexpr
+ZEND_BEGIN_ARG_INFO_EX(arginfo_clickhouse_result_set_iterator_type, 0, 0, 1)
+	ZEND_ARG_TYPE_INFO(0, resulttype, IS_LONG, 0)
+ZEND_END_ARG_INFO()
+
+PHP_METHOD(ClickHouseResultObject, set_iterator_type)
+{
+	zend_long resulttype;
+
+	ZEND_PARSE_PARAMETERS_START(1, 1)
+		Z_PARAM_LONG(resulttype)
+	ZEND_PARSE_PARAMETERS_END();
+
+	auto obj = Z_CLICKHOUSE_RESULT_P(ZEND_THIS);
+
+	obj->impl->set_iterator_type(ClickHouseResult::get_fetch_type(resulttype));
+}
+
+PHP_METHOD(ClickHouseResultObject, set_type_mapping)
+{
+	zend_long mapping;
+
+	ZEND_PARSE_PARAMETERS_START(1, 1)
+		Z_PARAM_LONG(mapping)
+	ZEND_PARSE_PARAMETERS_END();
+
+	auto obj = Z_CLICKHOUSE_RESULT_P(ZEND_THIS);
+
+	if (obj->impl->set_type_mapping(mapping))
+		RETURN_TRUE;
+	RETURN_FALSE;
+}
+
+// ReSharper disable once CppVariableCanBeMadeConstexpr
+ZEND_BEGIN_ARG_INFO_EX(arginfo_clickhouse_get_process_stats, 0, 0, 0)
+ZEND_END_ARG_INFO()
+
+PHP_FUNCTION(clickhouse_get_process_stats)
+{
+	ZEND_PARSE_PARAMETERS_NONE();
+
+	CLICKHOUSE_G(stats).to_array(return_value);
+
+	ClickHouseAsyncWriter::add_stats(return_value);
+	ClickHouseCache::add_stats(return_value);
+}
+
+static const zend_function_entry extension_functions[] = {
+	PHP_FE(clickhouse_get_process_stats, arginfo_clickhouse_get_process_stats)
 	PHP_FE_END
 };
 
@@ -253,7 +842,16 @@ static const zend_function_entry clickhouse_functions[] = {
 	PHP_ME(ClickHouseObject, __construct, arginfo_clickhouse_construct, ZEND_ACC_PUBLIC)
 	PHP_ME(ClickHouseObject, __destruct, arginfo_clickhouse_destruct, ZEND_ACC_PUBLIC)
 	PHP_ME(ClickHouseObject, query, arginfo_clickhouse_query, ZEND_ACC_PUBLIC)
+	PHP_ME(ClickHouseObject, query_to_stream, arginfo_clickhouse_query_to_stream, ZEND_ACC_PUBLIC)
 	PHP_ME(ClickHouseObject, insert, arginfo_clickhouse_insert, ZEND_ACC_PUBLIC)
+	PHP_ME(ClickHouseObject, insert_async, arginfo_clickhouse_insert, ZEND_ACC_PUBLIC)
+	PHP_ME(ClickHouseObject, start_query, arginfo_clickhouse_start_query, ZEND_ACC_PUBLIC)
+	PHP_ME(ClickHouseObject, get_stream, arginfo_clickhouse_get_stream, ZEND_ACC_PUBLIC)
+	PHP_ME(ClickHouseObject, process_io, arginfo_clickhouse_process_io, ZEND_ACC_PUBLIC)
+	PHP_ME(ClickHouseObject, get_result, arginfo_clickhouse_get_result, ZEND_ACC_PUBLIC)
+	PHP_ME(ClickHouseObject, query_parallel, arginfo_clickhouse_query_parallel, ZEND_ACC_PUBLIC)
+	PHP_ME(ClickHouseObject, set_type_mapping, arginfo_clickhouse_set_type_mapping, ZEND_ACC_PUBLIC)
+	PHP_ME(ClickHouseObject, get_stats, arginfo_clickhouse_get_stats, ZEND_ACC_PUBLIC)
 	PHP_FE_END
 };
 
@@ -263,11 +861,25 @@ static const zend_function_entry clickhouse_result_functions[] = {
 	PHP_ME(ClickHouseResultObject, fetch_row, arginfo_clickhouse_result_fetch_row, ZEND_ACC_PUBLIC)
 	PHP_ME(ClickHouseResultObject, fetch_array, arginfo_clickhouse_result_fetch_array, ZEND_ACC_PUBLIC)
 	PHP_ME(ClickHouseResultObject, fetch_all, arginfo_clickhouse_result_fetch_all, ZEND_ACC_PUBLIC)
+	PHP_ME(ClickHouseResultObject, fetch_many, arginfo_clickhouse_result_fetch_many, ZEND_ACC_PUBLIC)
+	PHP_ME(ClickHouseResultObject, fetch_block, arginfo_clickhouse_result_fetch_block, ZEND_ACC_PUBLIC)
+	PHP_ME(ClickHouseResultObject, fetch_object, arginfo_clickhouse_result_fetch_object, ZEND_ACC_PUBLIC)
+	PHP_ME(ClickHouseResultObject, data_seek, arginfo_clickhouse_result_data_seek, ZEND_ACC_PUBLIC)
+	PHP_ME(ClickHouseResultObject, fetch_row_at, arginfo_clickhouse_result_fetch_row_at, ZEND_ACC_PUBLIC)
+	PHP_ME(ClickHouseResultObject, fetch_all_objects, arginfo_clickhouse_result_fetch_all_objects, ZEND_ACC_PUBLIC)
+	PHP_ME(ClickHouseResultObject, set_iterator_type, arginfo_clickhouse_result_set_iterator_type, ZEND_ACC_PUBLIC)
+	PHP_ME(ClickHouseResultObject, set_type_mapping, arginfo_clickhouse_set_type_mapping, ZEND_ACC_PUBLIC)
 	PHP_FE_END
 };
 
 PHP_MINIT_FUNCTION(clickhouse)
 {
+	REGISTER_INI_ENTRIES();
+
+	// Mapped before FPM forks workers, so all of them share the same memory
+	if (CLICKHOUSE_G(cache_size) > 0)
+		ClickHouseCache::create(static_cast<size_t>(CLICKHOUSE_G(cache_size)));
+
 	// ClickHouse
 	zend_class_entry ce;
 	INIT_CLASS_ENTRY(ce, "ClickHouse", clickhouse_functions)
@@ -282,6 +894,24 @@ PHP_MINIT_FUNCTION(clickhouse)
 	REGISTER_LONG_CONSTANT("CLICKHOUSE_NUM", static_cast<zend_long>(ClickHouseResult::FetchType::NUM), CONST_CS | CONST_PERSISTENT);
 	REGISTER_LONG_CONSTANT("CLICKHOUSE_BOTH", static_cast<zend_long>(ClickHouseResult::FetchType::BOTH), CONST_CS | CONST_PERSISTENT);
 
+	REGISTER_LONG_CONSTANT("CLICKHOUSE_STORE_RESULT", ClickHouseResult::STORE_RESULT, CONST_CS | CONST_PERSISTENT);
+	REGISTER_LONG_CONSTANT("CLICKHOUSE_USE_RESULT", ClickHouseResult::USE_RESULT, CONST_CS | CONST_PERSISTENT);
+	REGISTER_LONG_CONSTANT("CLICKHOUSE_SEEKABLE_RESULT", ClickHouseResult::SEEKABLE_RESULT, CONST_CS | CONST_PERSISTENT);
+	REGISTER_LONG_CONSTANT("CLICKHOUSE_DIRECT_STRINGS", ClickHouseResult::DIRECT_STRINGS, CONST_CS | CONST_PERSISTENT);
+	REGISTER_LONG_CONSTANT("CLICKHOUSE_COMPRESSED_RESULT", ClickHouseResult::COMPRESSED_RESULT, CONST_CS | CONST_PERSISTENT);
+
+	REGISTER_LONG_CONSTANT("CLICKHOUSE_DATES_AS_TIMESTAMPS", ClickHouseResult::DATES_AS_TIMESTAMPS, CONST_CS | CONST_PERSISTENT);
+	REGISTER_LONG_CONSTANT("CLICKHOUSE_BIG_INTEGERS_AS_FLOAT", ClickHouseResult::BIG_INTEGERS_AS_FLOAT, CONST_CS | CONST_PERSISTENT);
+	REGISTER_LONG_CONSTANT("CLICKHOUSE_DECIMALS_AS_FLOAT", ClickHouseResult::DECIMALS_AS_FLOAT, CONST_CS | CONST_PERSISTENT);
+	REGISTER_LONG_CONSTANT("CLICKHOUSE_IPV4_AS_INT", ClickHouseResult::IPV4_AS_INT, CONST_CS | CONST_PERSISTENT);
+
+	REGISTER_LONG_CONSTANT("CLICKHOUSE_MERGE_CONCAT", static_cast<zend_long>(ClickHouseParallelQuery::Merge::CONCAT), CONST_CS | CONST_PERSISTENT);
+	REGISTER_LONG_CONSTANT("CLICKHOUSE_MERGE_SORTED", static_cast<zend_long>(ClickHouseParallelQuery::Merge::SORTED), CONST_CS | CONST_PERSISTENT);
+
+	REGISTER_LONG_CONSTANT("CLICKHOUSE_FORMAT_CSV", static_cast<zend_long>(ClickHouseExport::Format::CSV), CONST_CS | CONST_PERSISTENT);
+	REGISTER_LONG_CONSTANT("CLICKHOUSE_FORMAT_TSV", static_cast<zend_long>(ClickHouseExport::Format::TSV), CONST_CS | CONST_PERSISTENT);
+	REGISTER_LONG_CONSTANT("CLICKHOUSE_FORMAT_JSON_EACH_ROW", static_cast<zend_long>(ClickHouseExport::Format::JSON_EACH_ROW), CONST_CS | CONST_PERSISTENT);
+
  	zend_declare_property_long(clickhouse_class_entry, "errno", sizeof("errno") - 1, 0, ZEND_ACC_PUBLIC);
 	zend_declare_property_string(clickhouse_class_entry, "error", sizeof("error") - 1, "", ZEND_ACC_PUBLIC);
 
@@ -291,6 +921,8 @@ PHP_MINIT_FUNCTION(clickhouse)
 	zend_class_entry rce;
 	INIT_CLASS_ENTRY(rce, "ClickHouseResult", clickhouse_result_functions)
 	clickhouse_result_class_entry = zend_register_internal_class(&rce);
+	clickhouse_result_class_entry->get_iterator = clickhouse_result_get_iterator;
+	zend_class_implements(clickhouse_result_class_entry, 1, zend_ce_traversable);
 
 	memcpy(&clickhouse_object_result_handlers, &std_object_handlers, sizeof(zend_object_handlers));
 	clickhouse_object_result_handlers.offset = XtOffsetOf(ClickHouseResultObject, std);
@@ -301,6 +933,17 @@ PHP_MINIT_FUNCTION(clickhouse)
 	return SUCCESS;
 }
 
+PHP_MSHUTDOWN_FUNCTION(clickhouse)
+{
+	// Children of a fork drop inherited writers in the fork handler, only writers of this process are stopped here
+	ClickHouseAsyncWriter::stop_all();
+	ClickHouseCache::destroy();
+
+	UNREGISTER_INI_ENTRIES();
+
+	return SUCCESS;
+}
+
 PHP_RINIT_FUNCTION(clickhouse)
 {
 #if defined(ZTS) && defined(COMPILE_DL_CLICKHOUSE)
@@ -315,6 +958,13 @@ PHP_MINFO_FUNCTION(clickhouse)
 	php_info_print_table_start();
 	php_info_print_table_header(2, "ClickHouse support", "enabled");
 	php_info_print_table_end();
+
+	php_info_print_table_start();
+	php_info_print_table_header(2, "Process statistics", "Value");
+	CLICKHOUSE_G(stats).print_info();
+	php_info_print_table_end();
+
+	DISPLAY_INI_ENTRIES();
 }
 
 typedef void (*zend_ctor_type)(void*);
@@ -324,7 +974,7 @@ zend_module_entry clickhouse_module_entry = {
 	"clickhouse",								/* Extension name */
 	extension_functions,							/* zend_function_entry */
 	PHP_MINIT(clickhouse),							/* PHP_MINIT - Module initialization */
-	nullptr,								/* PHP_MSHUTDOWN - Module shutdown */
+	PHP_MSHUTDOWN(clickhouse),						/* PHP_MSHUTDOWN - Module shutdown */
 	PHP_RINIT(clickhouse),							/* PHP_RINIT - Request initialization */
 	nullptr,								/* PHP_RSHUTDOWN - Request shutdown */
 	PHP_MINFO(clickhouse),							/* PHP_MINFO - Module info */
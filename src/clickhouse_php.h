@@ -6,8 +6,11 @@
 #pragma GCC diagnostic ignored "-Wredundant-decls"
 #include <php.h>
 #include <ext/standard/info.h>
+#include <zend_interfaces.h>
 #pragma GCC diagnostic pop
 
+#include "ClickHouseStats.h"
+
 extern zend_module_entry clickhouse_module_entry;
 #define phpext_clickhouse_ptr &clickhouse_module_entry
 
@@ -18,9 +21,24 @@ inline zend_object_handlers clickhouse_object_handlers;
 inline zend_object_handlers clickhouse_object_result_handlers;
 
 ZEND_BEGIN_MODULE_GLOBALS(clickhouse)
-//
+	ClickHouseStats stats;
+
+	zend_long async_flush_rows;
+	zend_long async_flush_interval_ms;
+	zend_long async_max_rows;
+
+	zend_long cache_size;
+
+	zend_long spill_threshold;
+
+	char *slow_log;
+	zend_long slow_threshold_ms;
+	zend_long slow_log_sample;
+	uint64_t slow_log_calls;
 ZEND_END_MODULE_GLOBALS(clickhouse)
 
+ZEND_EXTERN_MODULE_GLOBALS(clickhouse)
+
 #ifdef ZTS
 #define CLICKHOUSE_G(v) TSRMG(clickhouse_globals_id, zend_clickhouse_globals*, v)
 #else
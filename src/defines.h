@@ -3,10 +3,20 @@
 #define DATE_FORMAT		"%Y-%m-%d"
 #define DATETIME_FORMAT		"%Y-%m-%d %H:%M:%S"
 
+// Extension is built for the baseline CPU, hot kernels get SSE4.2 and AVX2 clones selected at load time through ifunc
+#if defined(__x86_64__) && defined(__GNUC__) && !defined(__clang__) && defined(__ELF__)
+#define CLICKHOUSE_CPU_DISPATCH	1
+#define CPU_DISPATCH		__attribute__((target_clones("avx2", "sse4.2", "default"), optimize("tree-vectorize")))
+#else
+#define CLICKHOUSE_CPU_DISPATCH	0
+#define CPU_DISPATCH
+#endif
+
 #include <cinttypes>
 #include <cstring>
 #include <ctime>
 #include <cstdlib>
+#include <cmath>
 
 #include <string>
 #include <string_view>
@@ -16,6 +26,11 @@
 #include <unordered_set>
 #include <type_traits>
 #include <memory>
+#include <limits>
+#include <charconv>
+#include <algorithm>
+#include <array>
+#include <utility>
 
 using std::string;
 using std::string_view;
@@ -26,6 +41,7 @@ using std::unordered_set;
 
 using std::shared_ptr;
 using std::make_shared;
+using std::weak_ptr;
 
 using std::pair;
 
@@ -0,0 +1,66 @@
+#include "lz4_dispatch.h"
+#include "probes.h"
+
+extern "C"
+{
+	auto __real_LZ4_decompress_safe(const char *source, char *dest, int compressed_size, int max_decompressed_size) -> int;
+	auto __wrap_LZ4_decompress_safe(const char *source, char *dest, int compressed_size, int max_decompressed_size) -> int;
+}
+
+static thread_local DecompressStats thread_stats{};
+
+#if CLICKHOUSE_CPU_DISPATCH
+
+using DecompressFunction = int (*)(const char *source, char *dest, int compressed_size, int max_decompressed_size);
+
+// Called by the dynamic loader before any constructors, CPU features are initialized here
+extern "C" auto clickhouse_resolve_lz4_decompress_safe() -> DecompressFunction
+{
+	__builtin_cpu_init();
+
+	if (__builtin_cpu_supports("avx2"))
+		return &lz4_avx2::decompress_safe;
+
+	if (__builtin_cpu_supports("sse4.2"))
+		return &lz4_sse42::decompress_safe;
+
+	return &__real_LZ4_decompress_safe;
+}
+
+__attribute__((ifunc("clickhouse_resolve_lz4_decompress_safe"))) auto lz4_decompress_safe(const char *source, char *dest, int compressed_size, int max_decompressed_size) -> int;
+
+#else
+
+auto lz4_decompress_safe(const char *source, char *dest, int compressed_size, int max_decompressed_size) -> int
+{
+	return __real_LZ4_decompress_safe(source, dest, compressed_size, max_decompressed_size);
+}
+
+#endif
+
+auto __wrap_LZ4_decompress_safe(const char *source, char *dest, int compressed_size, int max_decompressed_size) -> int
+{
+	uint64_t start = ClickHouseStats::now();
+
+	int result = lz4_decompress_safe(source, dest, compressed_size, max_decompressed_size);
+
+	thread_stats.blocks++;
+	thread_stats.compressed_bytes += static_cast<uint64_t>(compressed_size);
+	thread_stats.decompressed_bytes += static_cast<uint64_t>(std::max(result, 0));
+	thread_stats.time += ClickHouseStats::now() - start;
+
+	// Network blocks are traced here, blocks of the compressed result store fire the same probe by themselves
+	CLICKHOUSE_PROBE(block__decompress, compressed_size, result);
+
+	return result;
+}
+
+auto lz4_get_thread_stats() -> DecompressStats
+{
+	return thread_stats;
+}
+
+auto lz4_get_stats_since(const DecompressStats &start) -> DecompressStats
+{
+	return {thread_stats.blocks - start.blocks, thread_stats.compressed_bytes - start.compressed_bytes, thread_stats.decompressed_bytes - start.decompressed_bytes, thread_stats.time - start.time};
+}
\ No newline at end of file
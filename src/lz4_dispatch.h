@@ -0,0 +1,29 @@
+#pragma once
+
+// LZ4 decompression built from the bundled LZ4 sources for SSE4.2 and AVX2 in lz4_sse42.cpp and lz4_avx2.cpp.
+// clickhouse-cpp calls LZ4_decompress_safe() for every compressed network block, the extension is linked with --wrap
+// for it, so those calls are counted and go to the variant chosen by ifunc at load time in lz4_dispatch.cpp.
+namespace lz4_sse42
+{
+	auto decompress_safe(const char *source, char *dest, int compressed_size, int max_decompressed_size) -> int;
+}
+
+namespace lz4_avx2
+{
+	auto decompress_safe(const char *source, char *dest, int compressed_size, int max_decompressed_size) -> int;
+}
+
+// Network blocks decompressed by a thread since it has started, differences around a call give the share of the call
+struct DecompressStats
+{
+	uint64_t blocks;
+	uint64_t compressed_bytes;
+	uint64_t decompressed_bytes;
+	uint64_t time;
+};
+
+[[nodiscard]] auto lz4_get_thread_stats() -> DecompressStats;
+[[nodiscard]] auto lz4_get_stats_since(const DecompressStats &start) -> DecompressStats;
+
+// Dispatched decompression which is not counted, for blocks kept by the extension itself
+auto lz4_decompress_safe(const char *source, char *dest, int compressed_size, int max_decompressed_size) -> int;
\ No newline at end of file
@@ -0,0 +1,11 @@
+#include "lz4_dispatch.h"
+
+#if CLICKHOUSE_CPU_DISPATCH
+
+#pragma GCC target("sse4.2")
+
+// LZ4 decompression for CPUs with SSE4.2
+#define LZ4_NAMESPACE lz4_sse42
+#include "lz4_variant.h"
+
+#endif
\ No newline at end of file
@@ -0,0 +1,35 @@
+#pragma once
+
+// Included once by each target-specific file after #pragma GCC target, LZ4_NAMESPACE names the variant.
+// LZ4 API functions become static and the rest of lz4.c lives in the namespace, so nothing clashes with the default build.
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+
+#pragma GCC diagnostic ignored "-Wunused-function"
+#pragma GCC diagnostic ignored "-Wcast-qual"
+#pragma GCC diagnostic ignored "-Wcast-align"
+#pragma GCC diagnostic ignored "-Wredundant-decls"
+#pragma GCC diagnostic ignored "-Wimplicit-fallthrough"
+#pragma GCC diagnostic ignored "-Wunused-parameter"
+
+// Assertions of LZ4 are off the same way as in the default build
+#undef assert
+
+#define LZ4LIB_VISIBILITY static
+#define LZ4_PUBLISH_STATIC_FUNCTIONS
+
+namespace LZ4_NAMESPACE
+{
+
+#include "contrib/lz4/lz4/lz4.c"
+
+auto decompress_safe(const char *source, char *dest, int compressed_size, int max_decompressed_size) -> int
+{
+	return LZ4_decompress_safe(source, dest, compressed_size, max_decompressed_size);
+}
+
+}
\ No newline at end of file
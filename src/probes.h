@@ -0,0 +1,21 @@
+#pragma once
+
+// USDT probes for bpftrace and SystemTap on live workers. Each one is a single nop until a tracer attaches to it,
+// arguments are only plain values already at hand. List them with: bpftrace -l 'usdt:modules/clickhouse.so:*'
+//
+// query__start(sql, length, resultmode)	query__done(rows, bytes, failed)
+// block__received(rows, columns)	block__decompress(compressed_length, length)	fetch__batch(rows)
+// insert__start(sql, rows)	insert__done(rows, failed)
+#if !defined(HAVE_SYS_SDT_H) && defined(__has_include)
+#if __has_include(<sys/sdt.h>)
+#define HAVE_SYS_SDT_H 1
+#endif
+#endif
+
+#ifdef HAVE_SYS_SDT_H
+#include <sys/sdt.h>
+
+#define CLICKHOUSE_PROBE(name, ...)		STAP_PROBEV(clickhouse, name, ##__VA_ARGS__)
+#else
+#define CLICKHOUSE_PROBE(name, ...)
+#endif
\ No newline at end of file
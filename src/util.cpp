@@ -4,68 +4,360 @@ namespace std
 {
 
 auto to_string(Int128 value) -> string
+{
+	char buffer[FORMAT_BUFFER_SIZE];
+
+	return {buffer, format_int128(value, buffer, sizeof(buffer))};
+}
+
+auto uuid_to_string(const UUID &uuid) -> string
+{
+	char buffer[FORMAT_BUFFER_SIZE];
+
+	return {buffer, format_uuid(uuid, buffer, sizeof(buffer))};
+}
+
+}
+
+auto format_int128(Int128 value, char *buffer, size_t size) -> size_t
 {
 	if (value == 0)
-		return {"0"};
+	{
+		buffer[0] = '0';
+		return 1;
+	}
 
 	bool negative = value < 0;
 	if (negative)
 		value *= -1;
 
-	char buffer[64] = {0};
-	char *end = buffer + sizeof(buffer) - 1;
-	*end = '\0';
+	// Digits are written from the end and moved to the beginning of the buffer
+	char *end = buffer + size;
+	char *begin = end;
 
 	while (value != 0)
 	{
-		if (end == buffer)
-			return {};
+		if (begin == buffer)
+			return 0;
 
-		*--end = "0123456789"[static_cast<int>(value % 10)];
+		*--begin = "0123456789"[static_cast<int>(value % 10)];
 		value /= 10;
 	}
 
 	if (negative)
-		*--end = '-';
+	{
+		if (begin == buffer)
+			return 0;
 
-	return {end};
+		*--begin = '-';
+	}
+
+	size_t length = static_cast<size_t>(end - begin);
+	memmove(buffer, begin, length);
+
+	return length;
 }
 
-auto hex_digit(unsigned v) -> char
+// Two hex digits for each byte value
+static constexpr auto HEX_PAIRS = []
+{
+	std::array<char, 512> pairs{};
+
+	for (size_t i = 0; i < 256; i++)
+	{
+		pairs[i * 2] = "0123456789abcdef"[i >> 4];
+		pairs[i * 2 + 1] = "0123456789abcdef"[i & 0xF];
+	}
+
+	return pairs;
+}();
+
+// Value of each hex digit character, -1 for other characters
+static constexpr auto HEX_VALUES = []
+{
+	std::array<int8_t, 256> values{};
+
+	for (int8_t &value : values)
+		value = -1;
+
+	for (int8_t i = 0; i < 10; i++)
+		values['0' + i] = i;
+
+	for (int8_t i = 0; i < 6; i++)
+	{
+		values['a' + i] = static_cast<int8_t>(10 + i);
+		values['A' + i] = static_cast<int8_t>(10 + i);
+	}
+
+	return values;
+}();
+
+auto format_uuid(const UUID &uuid, char *buffer, size_t size) -> size_t
 {
-	return v < 10 ? static_cast<char>('0' + v) : static_cast<char>('a' + (v - 10));
+	if (size < UUID_LENGTH)
+		return 0;
+
+	char *out = buffer;
+
+	// Bytes go from the highest one, dashes make 8-4-4-4-12 groups of digits
+	for (size_t i = 0; i < 16; i++)
+	{
+		if (i == 4 || i == 6 || i == 8 || i == 10)
+			*out++ = '-';
+
+		uint64_t half = (i < 8) ? uuid.first : uuid.second;
+		size_t byte = (half >> (56 - (i % 8) * 8)) & 0xFF;
+
+		memcpy(out, &HEX_PAIRS[byte * 2], 2);
+		out += 2;
+	}
+
+	return UUID_LENGTH;
 }
 
-auto uuid_to_string(const UUID &uuid) -> string
+auto parse_uuid(const string_view &text, UUID &uuid) -> bool
 {
-	uint64_t hi = uuid.first;
-	uint64_t lo = uuid.second;
+	uint64_t halves[2] = {0, 0};
 
-	// Стандартный формат: 8-4-4-4-12 = 36 символов
-	string out(36, '0');
-	int pos = 0;
+	// Binary form is 16 bytes in the same order as the text
+	if (text.size() == 16)
+	{
+		for (size_t i = 0; i < 16; i++)
+			halves[i / 8] = (halves[i / 8] << 8) | static_cast<unsigned char>(text[i]);
 
-	auto put_hex = [&](uint64_t value, int n) -> void
+		uuid = {halves[0], halves[1]};
+		return true;
+	}
+
+	// Text is 32 hex digits, with dashes between 8-4-4-4-12 groups or without them
+	bool with_dashes = (text.size() == UUID_LENGTH);
+	if (!with_dashes && text.size() != 32)
+		return false;
+
+	size_t digits = 0;
+	for (size_t i = 0; i < text.size(); i++)
 	{
-		for (int i = n - 1; i >= 0; --i)
+		if (with_dashes && (i == 8 || i == 13 || i == 18 || i == 23))
 		{
-			out[pos + i] = hex_digit(value & 0xF);
-			value >>= 4;
+			if (text[i] != '-')
+				return false;
+			continue;
 		}
-		pos += n;
 
-		if (pos < 36)
-			out[pos++] = '-';
-	};
+		int8_t value = HEX_VALUES[static_cast<unsigned char>(text[i])];
+		if (value < 0)
+			return false;
+
+		halves[digits / 16] = (halves[digits / 16] << 4) | static_cast<uint64_t>(value);
+		digits++;
+	}
+
+	uuid = {halves[0], halves[1]};
+	return true;
+}
+
+auto format_ip(const in_addr &value, char *buffer, size_t size) -> size_t
+{
+	if (size < IPV4_MAX_LENGTH)
+		return 0;
+
+	uint32_t address = ntohl(value.s_addr);
+
+	char *out = buffer;
+	for (int shift = 24; shift >= 0; shift -= 8)
+	{
+		out = std::to_chars(out, buffer + size, (address >> shift) & 0xFF).ptr;
+
+		if (shift != 0)
+			*out++ = '.';
+	}
+
+	return static_cast<size_t>(out - buffer);
+}
+
+auto format_ip(const in6_addr &value, char *buffer, size_t size) -> size_t
+{
+	if (inet_ntop(AF_INET6, &value, buffer, static_cast<socklen_t>(size)) == nullptr)
+		return 0;
+
+	return strlen(buffer);
+}
+
+auto format_date(time_t value, bool with_time, char *buffer, size_t size) -> size_t
+{
+	tm tm_time{};
+	gmtime_r(&value, &tm_time);
+
+	return strftime(buffer, size, with_time ? DATETIME_FORMAT : DATE_FORMAT, &tm_time);
+}
+
+auto format_decimal(const ColumnDecimal &column, size_t row, char *buffer, size_t size) -> size_t
+{
+	size_t length = format_int128(column.At(row), buffer, size);
+	if (length == 0)
+		return 0;
+
+	auto type_decimal = reinterpret_cast<DecimalType*>(column.Type().get());
+
+	// ReSharper disable once CppTooWideScopeInitStatement
+	size_t scale = type_decimal->GetScale();
+	if (scale == 0)
+		return length;
+
+	// Values below 1 need leading zeros before the point can be placed, e.g. 5 with scale 3 is 0.005
+	size_t sign = (buffer[0] == '-') ? 1 : 0;
+	size_t digits = length - sign;
+
+	size_t zeros = (digits <= scale) ? scale - digits + 1 : 0;
+	if (length + zeros + 1 > size)
+		return 0;
+
+	memmove(buffer + sign + zeros, buffer + sign, digits);
+	memset(buffer + sign, '0', zeros);
+	length += zeros;
 
-	// Поля UUID
-	put_hex((hi >> 32) & 0xffffffffULL, 8);
-	put_hex((hi >> 16) & 0xffffULL,4);
-	put_hex( hi	& 0xffffULL, 4);
-	put_hex((lo >> 48) & 0xffffULL, 4);
-	put_hex( lo	& 0xffffffffffffULL, 12);
+	memmove(buffer + length - scale + 1, buffer + length - scale, scale);
+	buffer[length - scale] = '.';
 
-	return out;
+	return length + 1;
 }
 
+// Chunks are checked without branches so the compiler can vectorize them, the first match is searched only in the last chunk
+template<class Predicate>
+[[gnu::always_inline]] static inline auto find_first(const char *data, size_t size, Predicate predicate) -> size_t
+{
+	static constexpr size_t CHUNK_SIZE = 32;
+
+	size_t i = 0;
+	for (; i + CHUNK_SIZE <= size; i += CHUNK_SIZE)
+	{
+		uint8_t found = 0;
+		for (size_t j = 0; j < CHUNK_SIZE; j++)
+			found |= predicate(static_cast<uint8_t>(data[i + j]));
+
+		if (found != 0)
+			break;
+	}
+
+	for (; i < size; i++)
+	{
+		if (predicate(static_cast<uint8_t>(data[i])))
+			return i;
+	}
+
+	return size;
+}
+
+CPU_DISPATCH auto find_csv_special(const char *data, size_t size) -> size_t
+{
+	return find_first(data, size, [] (uint8_t c) -> uint8_t { return c == '"'; });
+}
+
+CPU_DISPATCH auto find_tsv_special(const char *data, size_t size) -> size_t
+{
+	return find_first(data, size, [] (uint8_t c) -> uint8_t { return (c == '\\') | (c == '\t') | (c == '\n') | (c == '\r') | (c == '\0'); });
+}
+
+CPU_DISPATCH auto find_json_special(const char *data, size_t size) -> size_t
+{
+	return find_first(data, size, [] (uint8_t c) -> uint8_t { return (c == '"') | (c == '\\') | (c < 0x20); });
+}
+
+template<class T>
+static void convert_to_longs(const T *data, size_t count, zval *values)
+{
+	for (size_t i = 0; i < count; i++)
+		ZVAL_LONG(&values[i], static_cast<zend_long>(data[i]));
+}
+
+template<class T>
+static void convert_to_doubles(const T *data, size_t count, zval *values)
+{
+	for (size_t i = 0; i < count; i++)
+		ZVAL_DOUBLE(&values[i], static_cast<double>(data[i]));
+}
+
+CPU_DISPATCH void convert_longs(const int8_t *data, size_t count, zval *values)
+{
+	convert_to_longs(data, count, values);
+}
+
+CPU_DISPATCH void convert_longs(const int16_t *data, size_t count, zval *values)
+{
+	convert_to_longs(data, count, values);
+}
+
+CPU_DISPATCH void convert_longs(const int32_t *data, size_t count, zval *values)
+{
+	convert_to_longs(data, count, values);
+}
+
+CPU_DISPATCH void convert_longs(const int64_t *data, size_t count, zval *values)
+{
+	convert_to_longs(data, count, values);
+}
+
+CPU_DISPATCH void convert_longs(const uint8_t *data, size_t count, zval *values)
+{
+	convert_to_longs(data, count, values);
+}
+
+CPU_DISPATCH void convert_longs(const uint16_t *data, size_t count, zval *values)
+{
+	convert_to_longs(data, count, values);
+}
+
+CPU_DISPATCH void convert_longs(const uint32_t *data, size_t count, zval *values)
+{
+	convert_to_longs(data, count, values);
+}
+
+CPU_DISPATCH void convert_doubles(const float *data, size_t count, zval *values)
+{
+	convert_to_doubles(data, count, values);
+}
+
+CPU_DISPATCH void convert_doubles(const double *data, size_t count, zval *values)
+{
+	convert_to_doubles(data, count, values);
+}
+
+CPU_DISPATCH void convert_nulls(const uint8_t *nulls, size_t count, zval *values)
+{
+	// Null maps are mostly zeros, values are touched only after the vectorized scan finds a set byte
+	const char *data = reinterpret_cast<const char*>(nulls);
+
+	for (size_t i = find_first(data, count, [] (uint8_t c) -> uint8_t { return c; }); i < count;)
+	{
+		ZVAL_NULL(&values[i]);
+
+		i++;
+		i += find_first(data + i, count - i, [] (uint8_t c) -> uint8_t { return c; });
+	}
+}
+
+void apply_settings(Query &query, const ServerSettings &settings)
+{
+	// Important settings are rejected by the server if unknown instead of being silently ignored
+	for (const auto &[name, value] : settings)
+		query.SetSetting(name, QuerySettingsField{value, QuerySettingsField::IMPORTANT});
+}
+
+void append_settings(string &query, const ServerSettings &settings)
+{
+	for (size_t i = 0; i < settings.size(); i++)
+	{
+		query.append(i == 0 ? " SETTINGS " : ", ");
+		query.append(settings[i].first);
+		query.append(" = '");
+
+		for (char c : settings[i].second)
+		{
+			if (c == '\\' || c == '\'')
+				query.push_back('\\');
+			query.push_back(c);
+		}
+
+		query.push_back('\'');
+	}
 }
\ No newline at end of file
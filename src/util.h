@@ -1,7 +1,108 @@
 #pragma once
 
+#include <arpa/inet.h>
+
+// Enough for Int128 and Decimal128 with the sign and the point, UUID and IPv6 text
+inline constexpr size_t FORMAT_BUFFER_SIZE = 64;
+
+// Longest text of values formatted directly into PHP strings, 8-4-4-4-12 digits for UUID
+inline constexpr size_t UUID_LENGTH = 36;
+inline constexpr size_t IPV4_MAX_LENGTH = INET_ADDRSTRLEN - 1;
+inline constexpr size_t IPV6_MAX_LENGTH = INET6_ADDRSTRLEN - 1;
+
+// Allocator for containers owned by PHP objects, memory comes from the request heap and is visible to memory_limit
+template<class T>
+struct ZendAllocator
+{
+	using value_type = T;
+
+	ZendAllocator() = default;
+
+	template<class U>
+	ZendAllocator(const ZendAllocator<U>&) noexcept
+	{}
+
+	[[nodiscard]] auto allocate(size_t n) -> T*
+	{
+		return static_cast<T*>(safe_emalloc(n, sizeof(T), 0));
+	}
+
+	void deallocate(T *ptr, size_t) noexcept
+	{
+		efree(ptr);
+	}
+
+	template<class U>
+	auto operator==(const ZendAllocator<U>&) const noexcept -> bool
+	{
+		return true;
+	}
+};
+
 namespace std
 {
 	auto to_string(Int128 value) -> string;
 	auto uuid_to_string(const UUID &uuid) -> string;
-}
\ No newline at end of file
+}
+
+// Formatting functions write to the buffer without allocations and return the length, 0 on failure
+auto format_int128(Int128 value, char *buffer, size_t size) -> size_t;
+auto format_uuid(const UUID &uuid, char *buffer, size_t size) -> size_t;
+auto format_ip(const in_addr &value, char *buffer, size_t size) -> size_t;
+auto format_ip(const in6_addr &value, char *buffer, size_t size) -> size_t;
+auto format_date(time_t value, bool with_time, char *buffer, size_t size) -> size_t;
+auto format_decimal(const ColumnDecimal &column, size_t row, char *buffer, size_t size) -> size_t;
+
+// Accepts 8-4-4-4-12 text, 32 hex digits or 16 bytes of binary UUID
+[[nodiscard]] auto parse_uuid(const string_view &text, UUID &uuid) -> bool;
+
+// UUID and IP text is written to a PHP string allocated for the longest text of the type, without a temporary copy
+template<class T>
+auto format_zend_string(const T &value) -> zend_string*
+{
+	size_t max_length;
+	if constexpr (std::is_same_v<T, UUID>)
+		max_length = UUID_LENGTH;
+	else if constexpr (std::is_same_v<T, in_addr>)
+		max_length = IPV4_MAX_LENGTH;
+	else
+		max_length = IPV6_MAX_LENGTH;
+
+	zend_string *result = zend_string_alloc(max_length, false);
+
+	size_t length;
+	if constexpr (std::is_same_v<T, UUID>)
+		length = format_uuid(value, ZSTR_VAL(result), max_length + 1);
+	else
+		length = format_ip(value, ZSTR_VAL(result), max_length + 1);
+
+	ZSTR_LEN(result) = length;
+	ZSTR_VAL(result)[length] = '\0';
+
+	return result;
+}
+
+// Column-wide conversion of numeric values to zvals, without the per-value type switch
+void convert_longs(const int8_t *data, size_t count, zval *values);
+void convert_longs(const int16_t *data, size_t count, zval *values);
+void convert_longs(const int32_t *data, size_t count, zval *values);
+void convert_longs(const int64_t *data, size_t count, zval *values);
+void convert_longs(const uint8_t *data, size_t count, zval *values);
+void convert_longs(const uint16_t *data, size_t count, zval *values);
+void convert_longs(const uint32_t *data, size_t count, zval *values);
+void convert_doubles(const float *data, size_t count, zval *values);
+void convert_doubles(const double *data, size_t count, zval *values);
+// Sets values of rows marked in the null map of a Nullable column to null
+void convert_nulls(const uint8_t *nulls, size_t count, zval *values);
+
+auto find_csv_special(const char *data, size_t size) -> size_t;
+auto find_tsv_special(const char *data, size_t size) -> size_t;
+auto find_json_special(const char *data, size_t size) -> size_t;
+
+// Server settings sent in Query packet, values are passed as text and parsed by the server
+using ServerSettings = vector<pair<string, string>>;
+
+void apply_settings(Query &query, const ServerSettings &settings);
+
+// SETTINGS clause for queries sent as text only, names must be checked by the caller
+void append_settings(string &query, const ServerSettings &settings);
\ No newline at end of file